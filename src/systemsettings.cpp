@@ -60,3 +60,23 @@ QVariant SystemSettings::appValue(const QString &appName, const QString &key,
 {
     return m_settings->appValue(appName, key, defaultValue);
 }
+
+void SystemSettings::trackApp(const QString &appName)
+{
+    m_settings->trackApp(appName);
+}
+
+void SystemSettings::untrackApp(const QString &appName)
+{
+    m_settings->untrackApp(appName);
+}
+
+int SystemSettings::subscribe(const QString &prefix, QObject *receiver, UniSettings::ChangeHandler handler)
+{
+    return m_settings->subscribe(prefix, receiver, std::move(handler));
+}
+
+void SystemSettings::unsubscribe(int id)
+{
+    m_settings->unsubscribe(id);
+}
@@ -22,6 +22,13 @@ public:
     // For reading other app settings from system scope
     Q_INVOKABLE QVariant appValue(const QString &appName, const QString &key, 
                                    const QVariant &defaultValue = QVariant()) const;
+    // Report an app's changes key by key even with an app idle timeout set
+    Q_INVOKABLE void trackApp(const QString &appName);
+    Q_INVOKABLE void untrackApp(const QString &appName);
+
+    // Only changes to system keys under prefix, instead of settingChanged for all
+    int subscribe(const QString &prefix, QObject *receiver, UniSettings::ChangeHandler handler);
+    void unsubscribe(int id);
 
 signals:
     // Generic signal for any system setting change
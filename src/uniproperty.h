@@ -0,0 +1,185 @@
+#ifndef UNIPROPERTY_H
+#define UNIPROPERTY_H
+
+#include "unisettings.h"
+#include <QPointer>
+#include <QStringView>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+// Settings key usable as a template argument: UniProperty<int, "window/width">.
+// Decoded from UTF-8 to UTF-16 so it can be handed out as a QString without
+// copying. No character takes fewer UTF-8 bytes than UTF-16 units, so N is
+// always enough room.
+template <std::size_t N>
+struct UniFixedString
+{
+    char16_t data[N] = {};
+    std::size_t length = 0;
+
+    constexpr UniFixedString(const char (&key)[N])
+    {
+        for (std::size_t i = 0; i + 1 < N;) {
+            const char32_t lead = static_cast<unsigned char>(key[i]);
+            const std::size_t extra = lead < 0x80 ? 0 : lead < 0xe0 ? 1 : lead < 0xf0 ? 2 : 3;
+            char32_t code = extra == 0 ? lead : lead & (0x3f >> extra);
+            for (std::size_t j = 1; j <= extra; ++j) {
+                code = (code << 6) | (static_cast<unsigned char>(key[i + j]) & 0x3f);
+            }
+            i += extra + 1;
+            if (code >= 0x10000) {
+                data[length++] = char16_t(0xd800 + ((code - 0x10000) >> 10));
+                data[length++] = char16_t(0xdc00 + ((code - 0x10000) & 0x3ff));
+            } else {
+                data[length++] = char16_t(code);
+            }
+        }
+    }
+
+    constexpr qsizetype size() const { return qsizetype(length); }
+};
+
+// Conversion between a property type and the QVariant values UniSettings
+// stores. The common types get a direct conversion instead of the generic
+// QVariant::value<T>() path; anything else falls back to it.
+template <typename T, typename = void>
+struct UniPropertyTraits
+{
+    static T fromVariant(const QVariant &value) { return value.value<T>(); }
+    static QVariant toVariant(const T &value) { return QVariant::fromValue(value); }
+};
+
+template <>
+struct UniPropertyTraits<int>
+{
+    static int fromVariant(const QVariant &value) { return value.toInt(); }
+    static QVariant toVariant(int value) { return QVariant(value); }
+};
+
+template <>
+struct UniPropertyTraits<bool>
+{
+    static bool fromVariant(const QVariant &value) { return value.toBool(); }
+    static QVariant toVariant(bool value) { return QVariant(value); }
+};
+
+template <>
+struct UniPropertyTraits<double>
+{
+    static double fromVariant(const QVariant &value) { return value.toDouble(); }
+    static QVariant toVariant(double value) { return QVariant(value); }
+};
+
+template <>
+struct UniPropertyTraits<QString>
+{
+    static QString fromVariant(const QVariant &value) { return value.toString(); }
+    static QVariant toVariant(const QString &value) { return QVariant(value); }
+};
+
+// Enums are stored as their numeric value
+template <typename T>
+struct UniPropertyTraits<T, std::enable_if_t<std::is_enum_v<T>>>
+{
+    static T fromVariant(const QVariant &value) { return T(value.toLongLong()); }
+    static QVariant toVariant(T value) { return QVariant(qlonglong(value)); }
+};
+
+// Typed, cached settings value with a compile-time key. Reads return the
+// cached member; it's refreshed from UniSettings change notifications and
+// the owner's NOTIFY signal is emitted when it actually changes. To expose
+// it to QML, forward a Q_PROPERTY's READ/WRITE to value()/setValue():
+//
+//     Q_PROPERTY(int width READ width WRITE setWidth NOTIFY widthChanged)
+//     int width() const { return m_width; }
+//     void setWidth(int width) { m_width = width; }
+//     ...
+//     UniProperty<int, "window/width"> m_width{settings, this, &Owner::widthChanged, 1024};
+//
+// Key is the full key. settings is used without a group, like the macro
+// properties use theirs; reads, writes and the subscription would otherwise
+// all be moved under the group while changes are matched on the full key.
+template <typename T, UniFixedString Key>
+class UniProperty
+{
+public:
+    template <typename Owner>
+    UniProperty(UniSettings *settings, Owner *owner, void (Owner::*changed)(),
+                const T &defaultValue = T())
+        : m_settings(settings)
+        , m_default(defaultValue)
+        , m_value(read(settings->value(key())))
+        , m_changed([owner, changed]() { (owner->*changed)(); })
+    {
+        Q_ASSERT_X(settings->group().isEmpty(), "UniProperty", "constructed while a group is open");
+        m_subscription = settings->subscribe(key(), owner,
+                                             [this](const QString &changedKey, const QVariant &value) {
+            if (changedKey.size() == Key.size() && changedKey == key()) {
+                update(read(value));
+            }
+        });
+    }
+
+    ~UniProperty()
+    {
+        if (m_settings) {
+            m_settings->unsubscribe(m_subscription);
+        }
+    }
+
+    UniProperty(const UniProperty &) = delete;
+    UniProperty &operator=(const UniProperty &) = delete;
+
+    static QString key()
+    {
+        return QString::fromRawData(reinterpret_cast<const QChar *>(Key.data), Key.size());
+    }
+
+    const T &value() const { return m_value; }
+    operator const T &() const { return m_value; }
+    const T &defaultValue() const { return m_default; }
+
+    void setValue(const T &value)
+    {
+        if (m_value == value) {
+            return;
+        }
+        m_value = value;
+        if (m_settings) {
+            Q_ASSERT_X(m_settings->group().isEmpty(), "UniProperty::setValue", "called while a group is open");
+            // Comes back through the subscription, where it compares equal
+            m_settings->setValue(key(), UniPropertyTraits<T>::toVariant(value));
+        }
+        m_changed();
+    }
+
+    UniProperty &operator=(const T &value)
+    {
+        setValue(value);
+        return *this;
+    }
+
+private:
+    // A key that isn't set, or was removed, reads as the default
+    T read(const QVariant &value) const
+    {
+        return value.isValid() ? UniPropertyTraits<T>::fromVariant(value) : m_default;
+    }
+
+    void update(const T &value)
+    {
+        if (m_value != value) {
+            m_value = value;
+            m_changed();
+        }
+    }
+
+    QPointer<UniSettings> m_settings;
+    T m_default;
+    T m_value;
+    std::function<void()> m_changed;
+    int m_subscription = 0;
+};
+
+#endif // UNIPROPERTY_H
@@ -1,360 +1,1837 @@
 #include "unisettings.h"
+#include "unisettings_db.h"
+#include "unisettings_entries.h"
+#include "unisettings_ini.h"
+#include "unisettings_watcher.h"
+#ifdef UNISETTINGS_HAVE_BUS
+#include "unisettings_bus.h"
+#endif
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+#include "unisettings_shm.h"
+#endif
+#include <QAtomicPointer>
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
-#include <QFileSystemWatcher>
+#include <QLockFile>
 #include <QMutex>
+#include <QMetaMethod>
 #include <QMutexLocker>
-#include <QSettings>
+#include <QPointer>
 #include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QHash>
+#include <QSet>
+#include <QVarLengthArray>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <latch>
+#include <memory>
+#include <utility>
+#include <vector>
 
-class UniSettingsPrivate
+// A write that has been applied to the in-memory state but not yet
+// flushed to the backing file
+struct PendingWrite
+{
+    enum Type { Set, Remove, Clear };
+    Type type;
+    QString key;
+    QVariant value;
+};
+
+// Keys and raw values from the compiled copy of a config file, if there is
+// one and it was built from the file as it is now. Fills in the content
+// hash the copy recorded, so the file itself needn't be read at all.
+static bool readCompiledEntries(const QString &configPath, UniFileFingerprint &fingerprint,
+                                UniSettingsEntries &entries)
+{
+#ifdef UNISETTINGS_HAVE_COMPILED_DB
+    UniSettingsDb db(UniSettingsDb::pathFor(configPath));
+    if (!db.isFreshFor(fingerprint)) {
+        return false;
+    }
+    fingerprint.contentHash = db.sourceContentHash();
+    entries.reserve(db.size());
+    for (qsizetype i = 0; i < db.size(); ++i) {
+        entries.append(UniSettingsEntry{db.key(i).toString(), db.rawValue(i).toByteArray(), QVariant()});
+    }
+    return true;
+#else
+    Q_UNUSED(configPath)
+    Q_UNUSED(fingerprint)
+    Q_UNUSED(entries)
+    return false;
+#endif
+}
+
+// One config file as read when a store loads
+struct UniSettingsLoadedFile
+{
+    QString path;
+    UniFileFingerprint fingerprint;
+    UniSettingsEntries entries;
+};
+
+// Everything a store caches before it can answer reads: its own file and,
+// in system scope, every app config next to it
+struct UniSettingsLoad
+{
+    UniSettingsLoadedFile config;
+    QList<UniSettingsLoadedFile> apps;  // fingerprints only, unless asked for
+};
+
+// Without entries, only enough to tell later whether the file changed
+static UniSettingsLoadedFile loadConfigFile(const QString &path, bool withEntries = true)
+{
+    UniSettingsLoadedFile loaded{path, UniFileFingerprint::fromPath(path), UniSettingsEntries()};
+    if (!withEntries) {
+        loaded.fingerprint.contentHash = UniIniFile(path).contentHash();
+        return loaded;
+    }
+    if (!readCompiledEntries(path, loaded.fingerprint, loaded.entries)) {
+        UniIniFile file(path);
+        loaded.fingerprint.contentHash = file.contentHash();
+        loaded.entries = readEntries(file);
+#ifdef UNISETTINGS_HAVE_COMPILED_DB
+        // Last written by QSettings, by hand or by a build without compiled
+        // copies: compile it now so the next load needn't parse it. System
+        // configs in a read-only directory stay uncompiled.
+        if (loaded.fingerprint.exists && QFileInfo(QFileInfo(path).absolutePath()).isWritable()) {
+            QMap<QString, QByteArray> rawValues;
+            for (const UniSettingsEntry &entry : std::as_const(loaded.entries)) {
+                rawValues.insert(entry.key, entry.raw);
+            }
+            if (!UniSettingsDb::writeFile(UniSettingsDb::pathFor(path), rawValues, loaded.fingerprint)) {
+                qWarning() << "Failed to write compiled config:" << UniSettingsDb::pathFor(path);
+            }
+        }
+#endif
+    }
+    for (UniSettingsEntry &entry : loaded.entries) {
+        entry.value = UniIniFile::decodeValue(entry.raw);
+    }
+    return loaded;
+}
+
+// Files read by the calling thread and as many pool threads as are free,
+// each taking the next unread path. The caller never waits on a file nobody
+// has started, so this can't deadlock a busy pool; helpers that get a
+// thread after everything was taken just return.
+struct UniSettingsParallelRead
+{
+    UniSettingsParallelRead(const QStringList &filePaths, bool withAppEntries)
+        : paths(filePaths)
+        , withAppEntries(withAppEntries)
+        , files(filePaths.size())
+        , done(filePaths.size())
+    {
+    }
+
+    // After a cancel, files are still taken but no longer read
+    void work(const std::atomic<bool> *cancelled)
+    {
+        for (qsizetype i = next++; i < paths.size(); i = next++) {
+            if (!cancelled || !cancelled->load(std::memory_order_relaxed)) {
+                files[i] = loadConfigFile(paths.at(i), i == 0 || withAppEntries);
+            }
+            done.count_down();
+        }
+    }
+
+    const QStringList paths;
+    const bool withAppEntries;      // all but the first path
+    std::vector<UniSettingsLoadedFile> files;
+    std::atomic<qsizetype> next{0};
+    std::latch done;
+};
+
+static std::vector<UniSettingsLoadedFile> readConfigFiles(const QStringList &paths, bool withAppEntries,
+                                                          const std::atomic<bool> *cancelled)
+{
+    auto read = std::make_shared<UniSettingsParallelRead>(paths, withAppEntries);
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const qsizetype helpers = std::min<qsizetype>(paths.size(), pool->maxThreadCount()) - 1;
+    for (qsizetype i = 0; i < helpers; ++i) {
+        // A helper still queued after the caller returned may outlive the
+        // cancel flag, but by then it finds nothing left to take
+        pool->start([read, cancelled]() {
+            read->work(cancelled);
+        });
+    }
+    read->work(cancelled);
+    read->done.wait();
+    return std::move(read->files);
+}
+
+// Touches no QObject, so it may run on any thread. The app configs (system
+// scope) are read in parallel and only merged once all are in.
+static UniSettingsLoad loadConfigs(const QString &configPath, bool withApps, bool withAppEntries,
+                                   const std::atomic<bool> *cancelled = nullptr)
+{
+    QStringList paths{configPath};
+    if (withApps) {
+        QDir dir(QFileInfo(configPath).absolutePath());
+        const QFileInfoList configFiles = dir.entryInfoList({QStringLiteral("*.conf")}, QDir::Files);
+        for (const QFileInfo &configFile : configFiles) {
+            const QString filePath = configFile.absoluteFilePath();
+            if (filePath != configPath) {
+                paths.append(filePath);
+            }
+        }
+    }
+
+    std::vector<UniSettingsLoadedFile> files = readConfigFiles(paths, withAppEntries, cancelled);
+    UniSettingsLoad load;
+    load.config = std::move(files.front());
+    load.apps.reserve(qsizetype(files.size()) - 1);
+    for (auto it = files.begin() + 1; it != files.end(); ++it) {
+        load.apps.append(std::move(*it));
+    }
+    return load;
+}
+
+// A background load, run by whichever gets to it first: a pool thread, or
+// a read on the owning thread that would otherwise wait for a free one
+struct UniSettingsLoadJob
+{
+    QString configPath;
+    bool withApps = false;
+    bool withAppEntries = false;
+    std::atomic<bool> claimed{false};
+    // Set when the store goes away first; the rest of the files are skipped
+    std::atomic<bool> cancelled{false};
+    std::promise<UniSettingsLoad> result;
+
+    bool claim() { return !claimed.exchange(true); }
+};
+
+// Immutable view of every key that reads are served from; replaced as a
+// whole whenever the file or a local write changes something
+struct UniSettingsSnapshot
+{
+    std::atomic<int> ref{1};
+    QHash<QString, QVariant> values;
+
+    static void release(UniSettingsSnapshot *snapshot)
+    {
+        if (snapshot && snapshot->ref.fetch_sub(1) == 1) {
+            delete snapshot;
+        }
+    }
+};
+
+// RCU-style publication point. Readers on any thread pin the current
+// snapshot without locking; the owning thread swaps in new ones and frees
+// retired ones once no reader can still be between load and pin.
+class UniSettingsSnapshotSlot
 {
 public:
+    ~UniSettingsSnapshotSlot()
+    {
+        for (UniSettingsSnapshot *snapshot : std::as_const(retired)) {
+            UniSettingsSnapshot::release(snapshot);
+        }
+        UniSettingsSnapshot::release(published.load());
+    }
+
+    // Any thread: returns a pinned snapshot the caller must release, or
+    // null if nothing was published yet
+    UniSettingsSnapshot *acquire() const
+    {
+        readers.fetch_add(1);
+        UniSettingsSnapshot *snapshot = published.load();
+        if (snapshot) {
+            snapshot->ref.fetch_add(1);
+        }
+        readers.fetch_sub(1);
+        return snapshot;
+    }
+
+    // Owner thread only
+    void publish(UniSettingsSnapshot *snapshot)
+    {
+        UniSettingsSnapshot *old = published.exchange(snapshot);
+        if (old) {
+            retired.append(old);
+        }
+        if (readers.load() == 0) {
+            for (UniSettingsSnapshot *retiredSnapshot : std::as_const(retired)) {
+                UniSettingsSnapshot::release(retiredSnapshot);
+            }
+            retired.clear();
+        }
+    }
+
+private:
+    std::atomic<UniSettingsSnapshot *> published{nullptr};
+    mutable std::atomic<int> readers{0};
+    QList<UniSettingsSnapshot *> retired;
+};
+
+// Handlers by key prefix, one trie node per key segment, so a change only
+// visits the nodes on its own path however many subscribers there are
+class UniSettingsSubscriptions
+{
+public:
+    int add(const QString &prefix, QObject *receiver, UniSettings::ChangeHandler handler)
+    {
+        const QStringList path = prefix.split(u'/', Qt::SkipEmptyParts);
+        Node *node = &root;
+        for (const QString &segment : path) {
+            Node *&child = node->children[segment];
+            if (!child) {
+                child = new Node;
+            }
+            node = child;
+        }
+        const int id = ++lastId;
+        node->subscriptions.append(Subscription{id, receiver, receiver != nullptr, std::move(handler)});
+        paths.insert(id, path);
+        return id;
+    }
+
+    void remove(int id)
+    {
+        const QStringList path = paths.take(id);
+        QVarLengthArray<Node *, 8> chain;
+        chain.append(&root);
+        for (const QString &segment : path) {
+            Node *child = chain.last()->children.value(segment);
+            if (!child) {
+                return;
+            }
+            chain.append(child);
+        }
+        chain.last()->subscriptions.removeIf([id](const Subscription &subscription) {
+            return subscription.id == id;
+        });
+
+        // Prune nodes nothing hangs off anymore
+        for (qsizetype i = path.size(); i > 0; --i) {
+            Node *node = chain.at(i);
+            if (!node->subscriptions.isEmpty() || !node->children.isEmpty()) {
+                break;
+            }
+            chain.at(i - 1)->children.remove(path.at(i - 1));
+            delete node;
+        }
+    }
+
+    bool isEmpty() const { return paths.isEmpty(); }
+
+    void dispatch(const QString &key, const QVariant &value) const
+    {
+        // Collect first, handlers may subscribe or unsubscribe
+        QVarLengthArray<Subscription, 8> matched;
+        const Node *node = &root;
+        matched.append(node->subscriptions.constData(), node->subscriptions.size());
+        for (const QString &segment : key.split(u'/', Qt::SkipEmptyParts)) {
+            node = node->children.value(segment);
+            if (!node) {
+                break;
+            }
+            matched.append(node->subscriptions.constData(), node->subscriptions.size());
+        }
+
+        for (const Subscription &subscription : std::as_const(matched)) {
+            if (!subscription.bound || subscription.receiver) {
+                subscription.handler(key, value);
+            }
+        }
+    }
+
+private:
+    struct Subscription
+    {
+        int id;
+        QPointer<QObject> receiver;
+        bool bound;     // receiver was given, so stop once it's gone
+        UniSettings::ChangeHandler handler;
+    };
+
+    struct Node
+    {
+        ~Node() { qDeleteAll(children); }
+
+        QHash<QString, Node *> children;
+        QList<Subscription> subscriptions;
+    };
+
+    Node root;
+    QHash<int, QStringList> paths;
+    int lastId = 0;
+};
+
+// Read-only views of other apps' configs for appValue()/systemValue(),
+// shared by every instance in the process. A view is parsed on first use
+// and only re-checked after a watcher event marked it stale.
+class UniSettingsViewRegistry
+{
+public:
+    UniSettingsViewRegistry()
+        : configDir(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + "/unisettings")
+    {
+    }
+
+    QVariant value(const QString &appName, const QString &key, const QVariant &defaultValue)
+    {
+        QMutexLocker locker(&mutex);
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+        // A live system-scope publisher somewhere has every app parsed
+        // already. What it published only changes with the generation, so
+        // decoded values are kept until then.
+        const quint64 generation = shared.generation();
+        if (generation != 0 && !writtenSince(appName, generation)) {
+            if (generation != sharedGeneration) {
+                sharedValues.clear();
+                sharedGeneration = generation;
+            }
+            QHash<QString, SharedValue> &appValues = sharedValues[appName];
+            auto it = appValues.constFind(key);
+            if (it == appValues.cend()) {
+                bool found;
+                QByteArray raw;
+                if (shared.lookup(appName, key, &found, &raw)) {
+                    it = appValues.insert(key, SharedValue{found, found ? UniIniFile::decodeValue(raw) : QVariant()});
+                }
+            }
+            if (it != appValues.cend()) {
+                ++sharedReads;
+                return it->found ? it->value : defaultValue;
+            }
+        }
+#endif
+        View &view = views[appName];
+        if (view.stale) {
+            reload(configDir + "/" + appName + ".conf", view);
+        }
+        if (view.db) {
+            const qsizetype index = view.db->indexOf(key);
+            return index < 0 ? defaultValue : UniIniFile::decodeValue(view.db->rawValue(index));
+        }
+        return view.values.value(key, defaultValue);
+    }
+
+    // After this process wrote a config: its view is stale, and so is what
+    // the publisher has of it until its next generation
+    void written(const QString &path)
+    {
+        invalidate(path);
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+        QMutexLocker locker(&mutex);
+        writtenAt.insert(QFileInfo(path).completeBaseName(), shared.generation());
+#endif
+    }
+
+    // A store watching the view's file for as long as it reads it. The
+    // view itself goes with the last one; until then it stays cached.
+    void retain(const QString &appName)
+    {
+        QMutexLocker locker(&mutex);
+        ++holders[appName];
+    }
+
+    void release(const QString &appName)
+    {
+        QMutexLocker locker(&mutex);
+        auto it = holders.find(appName);
+        if (it == holders.end() || --it.value() > 0) {
+            return;
+        }
+        holders.erase(it);
+        views.remove(appName);
+    }
+
+    quint64 sharedReadCount()
+    {
+        QMutexLocker locker(&mutex);
+        return sharedReads;
+    }
+
+    // Called with whatever path a watcher reported
+    void invalidate(const QString &path)
+    {
+        QMutexLocker locker(&mutex);
+        QFileInfo fileInfo(path);
+        if (fileInfo.absolutePath() != configDir) {
+            // the directory itself: files may have been added or replaced
+            for (View &view : views) {
+                view.stale = true;
+            }
+            return;
+        }
+        auto it = views.find(fileInfo.completeBaseName());
+        if (it != views.end()) {
+            it->stale = true;
+        }
+    }
+
+private:
+    struct View
+    {
+        QHash<QString, QVariant> values;
+        // Answers lookups instead of values when a fresh compiled copy exists
+        std::shared_ptr<UniSettingsDb> db;
+        UniFileFingerprint fingerprint;
+        bool stale = true;
+    };
+
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+    struct SharedValue
+    {
+        bool found;
+        QVariant value;
+    };
+
+    // Whether we wrote the app's config after the publisher last published
+    bool writtenSince(const QString &appName, quint64 generation)
+    {
+        auto it = writtenAt.find(appName);
+        if (it == writtenAt.end()) {
+            return false;
+        }
+        if (generation > *it) {
+            writtenAt.erase(it);
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    static void reload(const QString &path, View &view)
+    {
+        view.stale = false;
+        UniFileFingerprint current = UniFileFingerprint::fromPath(path);
+        if (current.sameStat(view.fingerprint)) {
+            return;
+        }
+
+#ifdef UNISETTINGS_HAVE_COMPILED_DB
+        auto db = std::make_shared<UniSettingsDb>(UniSettingsDb::pathFor(path));
+        if (db->isFreshFor(current)) {
+            current.contentHash = db->sourceContentHash();
+            view.fingerprint = current;
+            view.values.clear();
+            view.db = std::move(db);
+            return;
+        }
+#endif
+
+        UniIniFile file(path);
+        current.contentHash = file.contentHash();
+        const bool sameContent = current.exists == view.fingerprint.exists
+                && current.contentHash == view.fingerprint.contentHash;
+        view.fingerprint = current;
+        if (sameContent && !view.db) {
+            return;
+        }
+
+        view.db.reset();
+        view.values.clear();
+        for (const UniIniFile::Entry &entry : file.entries()) {
+            view.values.insert(file.key(entry), file.value(entry));
+        }
+    }
+
+    const QString configDir;
+    QMutex mutex;
+    QHash<QString, View> views;
+    QHash<QString, int> holders;
+    quint64 sharedReads = 0;
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+    UniSettingsShmReader shared;
+    quint64 sharedGeneration = 0;
+    QHash<QString, QHash<QString, SharedValue>> sharedValues;
+    // Generation current when we last wrote each app's config
+    QHash<QString, quint64> writtenAt;
+#endif
+};
+
+Q_GLOBAL_STATIC(UniSettingsViewRegistry, s_viewRegistry)
+
+// Everything one config file needs: the cache, queued writes, the watcher
+// and the timers. Instances for the same app share a single store, looked
+// up through acquireStore() below; each of them keeps only its group.
+class UniSettingsStore : public QObject, public std::enable_shared_from_this<UniSettingsStore>
+{
+public:
+    enum LoadState { Unloaded, Loading, Loaded };
+
     QString appName;
     UniSettings::Scope scope;
+    LoadState loadState;
+    std::shared_ptr<UniSettingsLoadJob> loadJob;    // while Loading
+    std::future<UniSettingsLoad> loadResult;
+    // Set up by start(); the caches are filled once Loaded
     QString configPath;
-    QSettings *settings;
-    QString currentGroup;
-    QFileSystemWatcher *watcher;
+    UniSettingsWatcher *watcher;
     QTimer *debounceTimer;
-    QHash<QString, QVariant> cachedValues;
-    // Track cached values for all apps (system scope only)
-    QHash<QString, QHash<QString, QVariant>> appCachedValues;
-    bool ignoreNextChange;
+    QTimer *flushTimer;
+    int writeDelay;
+    QList<PendingWrite> pendingWrites;
+    // Open beginBatch() calls of all instances; writes stay queued until
+    // the outermost commit
+    int batchDepth;
+    QVariantHash batchChanges;
+    bool detectDeferred;
+    UniSettingsEntries cachedValues;
+    UniSettingsSnapshotSlot snapshots;
+    // Local writes since the last publish; see invalidateSnapshot()
+    bool snapshotStale;
+    // Last seen state of every diffed file, keyed by path
+    QHash<QString, UniFileFingerprint> fingerprints;
+    UniSettings::Metrics metrics;
+    // Contents of the app configs in use, or of all of them unless an idle
+    // timeout is set; the rest are only fingerprinted (system scope only)
+    QHash<QString, UniSettingsEntries> appCachedValues;
+    QSet<QString> knownAppFiles;
+    int appIdleTimeout;             // < 0: cache every app
+    QHash<QString, int> appTrackers;
+    QHash<QString, qint64> appLastUsed;
+    QElapsedTimer clock;
+    QTimer *evictTimer;
+    // Paths reported by the watcher since the last debounce run
+    QSet<QString> dirtyPaths;
+    // Every UniSettings object currently using this store
+    QList<UniSettings *> instances;
+    // Other configs read through the view registry, watched while we exist
+    QSet<QString> viewedPaths;
+    UniSettingsSubscriptions subscriptions;
+#ifdef UNISETTINGS_HAVE_BUS
+    UniSettingsBus *bus;
+#endif
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+    // Publishes every app's values for other processes (system scope only)
+    UniSettingsShmPublisher sharedPublisher;
+#endif
+
+    UniSettingsStore(const QString &app, UniSettings::Scope s)
+        : appName(app)
+        , scope(s)
+        , loadState(Unloaded)
+        , watcher(nullptr)
+        , debounceTimer(nullptr)
+        , flushTimer(nullptr)
+        , writeDelay(0)
+        , batchDepth(0)
+        , detectDeferred(false)
+        , snapshotStale(false)
+        , appIdleTimeout(-1)
+        , evictTimer(nullptr)
+    {
+    }
+
+    ~UniSettingsStore() override
+    {
+        if (loadJob) {
+            loadJob->cancelled.store(true);
+        }
+        // An uncommitted batch is written rather than lost
+        batchDepth = 0;
+        flush();
+        if (!s_viewRegistry.isDestroyed()) {
+            for (const QString &path : std::as_const(viewedPaths)) {
+                s_viewRegistry->release(QFileInfo(path).completeBaseName());
+            }
+        }
+    }
+
+    void requestLoad(UniSettings::LoadMode mode)
+    {
+        switch (mode) {
+        case UniSettings::LoadImmediately:
+            ensureLoaded();
+            break;
+        case UniSettings::LoadInBackground:
+            startLoading();
+            break;
+        case UniSettings::LoadOnDemand:
+            break;
+        }
+    }
+
+    // Read the configs in the pool; ensureLoaded() picks the result up
+    void startLoading()
+    {
+        if (loadState != Unloaded) {
+            return;
+        }
+        start();
+        loadState = Loading;
+        loadJob = std::make_shared<UniSettingsLoadJob>();
+        loadJob->configPath = configPath;
+        loadJob->withApps = scope == UniSettings::SystemScope;
+        loadJob->withAppEntries = cachesAllApps();
+        loadResult = loadJob->result.get_future();
+        QThreadPool::globalInstance()->start([job = loadJob]() {
+            if (job->claim()) {
+                job->result.set_value(loadConfigs(job->configPath, job->withApps,
+                                                  job->withAppEntries, &job->cancelled));
+            }
+        });
+    }
+
+    // Called before anything that needs the cache. Blocks only while a
+    // background load is halfway through; one still queued is run here.
+    void ensureLoaded()
+    {
+        if (loadState == Loaded) {
+            return;
+        }
+        const bool withApps = scope == UniSettings::SystemScope;
+        if (loadState == Unloaded) {
+            start();
+            applyLoad(loadConfigs(configPath, withApps, cachesAllApps()));
+            return;
+        }
+
+        UniSettingsLoad load = loadJob->claim()
+                ? loadConfigs(configPath, withApps, loadJob->withAppEntries)
+                : loadResult.get();
+        loadJob.reset();
+        applyLoad(std::move(load));
+        // Only the directory was watched while the app configs were read;
+        // a stat of each catches edits made in the meantime
+        if (!knownAppFiles.isEmpty()) {
+            dirtyPaths.unite(knownAppFiles);
+            debounceTimer->start();
+        }
+    }
+
+    // Config path, watcher and timers; cheap next to reading the files.
+    // Cross-app reads may run it ahead of the load.
+    void start()
+    {
+        if (watcher) {
+            return;
+        }
+        QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
+        configDir += "/unisettings";
+        QDir dir;
+        dir.mkpath(configDir);
+        if (scope == UniSettings::SystemScope) {
+            configPath = configDir + "/system.conf";
+        } else {
+            configPath = configDir + "/" + appName + ".conf";
+        }
+
+        watcher = UniSettingsWatcher::create(configDir, this);
+        watcher->watchFile(configPath);
+
+        debounceTimer = new QTimer(this);
+        debounceTimer->setSingleShot(true);
+        debounceTimer->setInterval(100);
+        connect(debounceTimer, &QTimer::timeout, this, [this]() {
+            if (scope == UniSettings::SystemScope) {
+                processSystemChanges();
+            } else {
+                processApplicationChanges();
+            }
+        });
+
+        flushTimer = new QTimer(this);
+        flushTimer->setSingleShot(true);
+        connect(flushTimer, &QTimer::timeout, this, [this]() {
+            flush();
+        });
+
+        clock.start();
+        evictTimer = new QTimer(this);
+        evictTimer->setSingleShot(true);
+        connect(evictTimer, &QTimer::timeout, this, [this]() {
+            evictIdleApps();
+        });
+
+        connect(watcher, &UniSettingsWatcher::fileChanged,
+                this, &UniSettingsStore::onFileChanged);
+        connect(watcher, &UniSettingsWatcher::directoryChanged,
+                this, &UniSettingsStore::onFileChanged);
+
+#ifdef UNISETTINGS_HAVE_BUS
+        bus = new UniSettingsBus(this);
+        connect(bus, &UniSettingsBus::messageReceived,
+                this, &UniSettingsStore::applyBusMessage);
+#endif
+    }
+
+    void applyLoad(UniSettingsLoad &&load)
+    {
+        loadState = Loaded;
+        fingerprints.insert(configPath, load.config.fingerprint);
+        cachedValues = std::move(load.config.entries);
+        publishSnapshot();
+
+        // Watch every existing app config (system scope only); the load
+        // read their contents if all of them are to be cached
+        for (UniSettingsLoadedFile &app : load.apps) {
+            watcher->watchFile(app.path);
+            knownAppFiles.insert(app.path);
+            fingerprints.insert(app.path, app.fingerprint);
+            if (cachesAllApps()) {
+                appCachedValues.insert(QFileInfo(app.path).completeBaseName(), std::move(app.entries));
+            }
+        }
+        if (scope == UniSettings::SystemScope) {
+            publishShared();
+        }
+    }
+
+    // Emit on every attached instance. A slot may delete instances, the
+    // last one included, so hold on to ourselves and skip the dead ones.
+    template <typename Emit>
+    void notifyInstances(Emit emitSignal)
+    {
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        const QList<QPointer<UniSettings>> targets(instances.cbegin(), instances.cend());
+        for (const QPointer<UniSettings> &instance : targets) {
+            if (instance) {
+                emitSignal(instance.data());
+            }
+        }
+    }
+
+    // An empty prefix, remove("") outside any group, covers every key
+    static bool isSameOrChildKey(const QString &key, const QString &prefix)
+    {
+        return prefix.isEmpty() || key == prefix
+            || (key.startsWith(prefix) && key.at(prefix.size()) == QLatin1Char('/'));
+    }
+
+    void publishSnapshot()
+    {
+        snapshotStale = false;
+        auto *snapshot = new UniSettingsSnapshot;
+        snapshot->values.reserve(cachedValues.size());
+        for (const UniSettingsEntry &entry : std::as_const(cachedValues)) {
+            snapshot->values.insert(entry.key, entry.value);
+        }
+        snapshots.publish(snapshot);
+    }
+
+    // Local writes don't rebuild the snapshot each time. It's republished
+    // once per event loop pass, at the end of the outermost batch, or when
+    // the owner asks for a snapshot, whichever comes first.
+    void invalidateSnapshot()
+    {
+        if (snapshotStale) {
+            return;
+        }
+        snapshotStale = true;
+        QMetaObject::invokeMethod(this, [this]() {
+            if (batchDepth == 0) {
+                publishStaleSnapshot();
+            }
+        }, Qt::QueuedConnection);
+    }
+
+    void publishStaleSnapshot()
+    {
+        if (snapshotStale) {
+            publishSnapshot();
+        }
+    }
+
+    // Owner thread reads go to the cache itself, which is always current
+    const UniSettingsEntry *cachedValue(const QString &key) const
+    {
+        auto it = std::lower_bound(cachedValues.cbegin(), cachedValues.cend(), key, entryKeyLess);
+        return it != cachedValues.cend() && it->key == key ? &*it : nullptr;
+    }
+
+    void setCachedValue(const QString &key, const QVariant &value)
+    {
+        auto it = std::lower_bound(cachedValues.begin(), cachedValues.end(), key, entryKeyLess);
+        if (it != cachedValues.end() && it->key == key) {
+            it->raw = UniIniFile::encodeValue(value);
+            it->value = value;
+        } else {
+            cachedValues.insert(it, UniSettingsEntry{key, UniIniFile::encodeValue(value), value});
+        }
+    }
+
+    // QSettings::remove() semantics: the key and everything below it.
+    // Returns the keys that were there, each with an invalid value.
+    QVariantHash removeCachedKey(const QString &key)
+    {
+        QVariantHash removed;
+        cachedValues.removeIf([&key, &removed](const UniSettingsEntry &entry) {
+            if (!isSameOrChildKey(entry.key, key)) {
+                return false;
+            }
+            removed.insert(entry.key, QVariant());
+            return true;
+        });
+        return removed;
+    }
+
+    // Queue a write and flush it now or once the write-behind window ends
+    void scheduleWrite(const PendingWrite &write)
+    {
+        if (write.type == PendingWrite::Clear) {
+            pendingWrites.clear();
+        }
+        pendingWrites.append(write);
+        requestFlush();
+    }
+
+    // Nothing is queued before the load, which is also what creates the
+    // flush timer, so an unloaded store returns here
+    void requestFlush()
+    {
+        if (batchDepth > 0 || pendingWrites.isEmpty()) {
+            return;
+        }
+        if (writeDelay <= 0) {
+            flush();
+        } else if (!flushTimer->isActive()) {
+            flushTimer->start(writeDelay);
+        }
+    }
+
+    // The outermost batch closed, by commitBatch() or by destroying an
+    // instance that left its batch open: write and report what it held
+    void finishBatch()
+    {
+        publishStaleSnapshot();
+        requestFlush();
+        if (detectDeferred) {
+            detectDeferred = false;
+            dirtyPaths.insert(configPath);
+            debounceTimer->start();
+        }
+
+        QVariantHash changes;
+        changes.swap(batchChanges);
+        notifyLocalChanges(changes);
+    }
+
+    // Several local writes at once: one valuesChanged() per instance,
+    // preceded by the per-key signals unless the instance turned them off
+    void notifyLocalChanges(const QVariantHash &changes)
+    {
+        if (changes.isEmpty()) {
+            return;
+        }
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        notifyInstances([&changes](UniSettings *instance) {
+            if (instance->perKeySignalsEnabled()) {
+                for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+                    emit instance->valueChanged(it.key(), it.value());
+                }
+            }
+            emit instance->valuesChanged(changes);
+        });
+        dispatchChanges(changes);
+    }
+
+    // Merge unflushed writes into what is on disk now and replace the file
+    // once, so keys written by other processes in the meantime survive
+    void writePendingWrites()
+    {
+        if (pendingWrites.isEmpty()) {
+            return;
+        }
+
+        // The same lock QSettings takes, so writers in other processes,
+        // plain QSettings ones included, don't drop each other's keys
+        QLockFile lock(configPath + ".lock");
+        if (!lock.lock()) {
+            qWarning() << "Failed to lock config file, writes stay queued:" << configPath;
+            return;
+        }
+
+        UniFileFingerprint &known = fingerprints[configPath];
+        UniFileFingerprint onDisk = UniFileFingerprint::fromPath(configPath);
+        bool foreignChange;
+        QMap<QString, QByteArray> rawValues;
+        {
+            UniIniFile file(configPath);
+            onDisk.contentHash = file.contentHash();
+            foreignChange = onDisk.exists != known.exists || onDisk.contentHash != known.contentHash;
+            for (const UniIniFile::Entry &entry : file.entries()) {
+                rawValues.insert(file.key(entry), entry.value.toByteArray());
+            }
+        }
+
+#ifdef UNISETTINGS_HAVE_BUS
+        UniSettingsBusMessage message;
+        message.appName = appName;
+        message.base = onDisk;
+        message.ops.reserve(pendingWrites.size());
+#endif
+        for (const PendingWrite &write : std::as_const(pendingWrites)) {
+            QByteArray raw;
+            switch (write.type) {
+            case PendingWrite::Set:
+                raw = UniIniFile::encodeValue(write.value);
+                rawValues.insert(write.key, raw);
+                break;
+            case PendingWrite::Remove:
+                rawValues.removeIf([&write](const QMap<QString, QByteArray>::iterator it) {
+                    return isSameOrChildKey(it.key(), write.key);
+                });
+                break;
+            case PendingWrite::Clear:
+                rawValues.clear();
+                break;
+            }
+#ifdef UNISETTINGS_HAVE_BUS
+            message.ops.append(UniSettingsBusMessage::Op{UniSettingsBusMessage::OpType(write.type), write.key, raw});
+#endif
+        }
+
+        // Dropped only once they're on disk, so a failed write is retried
+        // with the next flush rather than lost
+        UniFileFingerprint written;
+        if (!UniIniFile::writeFile(configPath, UniIniFile::serialize(rawValues), &written)) {
+            qWarning() << "Failed to write config file, writes stay queued:" << configPath;
+            return;
+        }
+        pendingWrites.clear();
+        lock.unlock();
+
+#ifdef UNISETTINGS_HAVE_COMPILED_DB
+        if (written.exists
+            && !UniSettingsDb::writeFile(UniSettingsDb::pathFor(configPath), rawValues, written)) {
+            qWarning() << "Failed to write compiled config:" << UniSettingsDb::pathFor(configPath);
+        }
+#endif
+        if (scope == UniSettings::SystemScope) {
+            publishShared();
+        }
+#ifdef UNISETTINGS_HAVE_BUS
+        if (written.exists) {
+            message.written = written;
+            bus->publish(message);
+        }
+#endif
+
+        // Remember exactly what we wrote so the watcher event for it is
+        // skipped by fingerprint. If another process wrote since we last
+        // looked, keep the old fingerprint so the next check still diffs
+        // and reports their keys; ours compare equal and stay quiet.
+        if (!foreignChange && written.exists) {
+            known = written;
+        }
+
+        // appValue() reads of this app mustn't wait for the watcher event,
+        // which comes a debounce later, or never while nothing watches
+        s_viewRegistry->written(configPath);
+    }
+
+    // Whatever is still queued, an open batch included
+    void flushForExit()
+    {
+        if (flushTimer) {
+            flushTimer->stop();
+        }
+        writePendingWrites();
+    }
+
+    // One file rewrite for everything queued since the last flush
+    void flush()
+    {
+        if (batchDepth > 0) {
+            return;
+        }
+        if (flushTimer) {
+            flushTimer->stop();
+        }
+        if (pendingWrites.isEmpty()) {
+            return;
+        }
+        writePendingWrites();
+    }
+
+    // Whether a config file differs from when it was last looked at,
+    // updating its fingerprint. Files whose stat is unchanged aren't read;
+    // the others are opened into file for the caller to diff.
+    bool fileChanged(const QString &path, std::unique_ptr<UniIniFile> &file)
+    {
+        ++metrics.fileChecks;
+
+        UniFileFingerprint current = UniFileFingerprint::fromPath(path);
+        UniFileFingerprint &known = fingerprints[path];
+        if (current.sameStat(known)) {
+            ++metrics.diffsSkipped;
+            return false;
+        }
+
+        file = std::make_unique<UniIniFile>(path);
+        current.contentHash = file->contentHash();
+        const bool sameContent = current.exists == known.exists
+                && current.contentHash == known.contentHash;
+        known = current;
+        if (sameContent) {
+            ++metrics.diffsSkipped;
+            return false;
+        }
+        return true;
+    }
+
+    // Diff a config file against its cached values, updating the cache
+    QHash<QString, QVariant> diffFile(const QString &path, UniSettingsEntries &cached)
+    {
+        std::unique_ptr<UniIniFile> file;
+        if (!fileChanged(path, file)) {
+            return QHash<QString, QVariant>();
+        }
+        return mergeEntries(cached, readEntries(*file));
+    }
+
+    QHash<QString, QVariant> detectChanges()
+    {
+        QHash<QString, QVariant> changes;
+        // Don't let a foreign change expose a half-applied batch; rerun
+        // detection once it's committed
+        if (batchDepth > 0) {
+            detectDeferred = true;
+            return changes;
+        }
+
+        // Merge our unflushed writes first so they aren't reported as
+        // reverted by the file contents
+        writePendingWrites();
+        changes = diffFile(configPath, cachedValues);
+        if (!changes.isEmpty()) {
+            publishSnapshot();
+        }
+        return changes;
+    }
+
+    // Detect changes for a specific app config (system scope only). For an
+    // app whose contents aren't cached, only whether it changed is known.
+    QHash<QString, QVariant> detectAppChanges(const QString &path, const QString &appName,
+                                              bool *changed)
+    {
+        auto cached = appCachedValues.find(appName);
+        if (cached == appCachedValues.end() && cachesApp(appName)) {
+            // A new file, or one recreated after being deleted
+            fingerprints.remove(path);
+            cached = appCachedValues.insert(appName, UniSettingsEntries());
+        }
+        if (cached == appCachedValues.end()) {
+            std::unique_ptr<UniIniFile> file;
+            *changed = fileChanged(path, file);
+            return QHash<QString, QVariant>();
+        }
+        QHash<QString, QVariant> changes = diffFile(path, *cached);
+        *changed = !changes.isEmpty();
+        return changes;
+    }
+
+    QString appConfigPath(const QString &fileAppName) const
+    {
+        return QFileInfo(configPath).absolutePath() + "/" + fileAppName + ".conf";
+    }
+
+    // Whether every app's contents stay cached, not just those in use
+    bool cachesAllApps() const
+    {
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+        // The shared segment is built from them
+        return true;
+#else
+        return appIdleTimeout < 0;
+#endif
+    }
+
+    bool cachesApp(const QString &fileAppName) const
+    {
+        return cachesAllApps() || appTrackers.value(fileAppName) > 0;
+    }
+
+    // An app's cached contents, read now if they weren't; null if the app
+    // has no config. Reading one restarts its idle period.
+    const UniSettingsEntries *cacheApp(const QString &fileAppName)
+    {
+        auto it = appCachedValues.find(fileAppName);
+        if (it == appCachedValues.end()) {
+            const QString path = appConfigPath(fileAppName);
+            UniSettingsLoadedFile loaded = loadConfigFile(path);
+            if (!loaded.fingerprint.exists) {
+                return nullptr;
+            }
+            fingerprints.insert(path, loaded.fingerprint);
+            it = appCachedValues.insert(fileAppName, std::move(loaded.entries));
+        }
+        touchApp(fileAppName);
+        return &it.value();
+    }
+
+    void touchApp(const QString &fileAppName)
+    {
+        if (cachesAllApps()) {
+            return;
+        }
+        appLastUsed.insert(fileAppName, clock.elapsed());
+        if (!evictTimer->isActive()) {
+            evictTimer->start(appIdleTimeout);
+        }
+    }
+
+    // Drop the contents of untracked apps idle for appIdleTimeout, going
+    // back to fingerprints for them, and re-arm for the next to expire
+    void evictIdleApps()
+    {
+        if (cachesAllApps()) {
+            return;
+        }
+        const qint64 now = clock.elapsed();
+        qint64 nextExpiry = -1;
+        for (auto it = appCachedValues.begin(); it != appCachedValues.end();) {
+            if (appTrackers.value(it.key()) > 0) {
+                ++it;
+                continue;
+            }
+            const qint64 idle = now - appLastUsed.value(it.key(), now);
+            if (idle >= appIdleTimeout) {
+                appLastUsed.remove(it.key());
+                it = appCachedValues.erase(it);
+                continue;
+            }
+            const qint64 remaining = appIdleTimeout - idle;
+            nextExpiry = nextExpiry < 0 ? remaining : std::min(nextExpiry, remaining);
+            ++it;
+        }
+        if (nextExpiry >= 0) {
+            evictTimer->start(int(nextExpiry));
+        }
+    }
+
+    void trackApp(const QString &fileAppName)
+    {
+        ++appTrackers[fileAppName];
+        cacheApp(fileAppName);
+    }
+
+    void untrackApp(const QString &fileAppName)
+    {
+        auto it = appTrackers.find(fileAppName);
+        if (it == appTrackers.end() || --it.value() > 0) {
+            return;
+        }
+        appTrackers.erase(it);
+        // Idle from now on
+        if (appCachedValues.contains(fileAppName)) {
+            touchApp(fileAppName);
+        }
+    }
+
+    void setAppIdleTimeout(int msec)
+    {
+        // A load underway was started for the old setting
+        if (loadState == Loading) {
+            ensureLoaded();
+        }
+        appIdleTimeout = msec;
+        if (loadState != Loaded || scope != UniSettings::SystemScope) {
+            return;
+        }
+        if (cachesAllApps()) {
+            evictTimer->stop();
+            appLastUsed.clear();
+            for (const QString &path : std::as_const(knownAppFiles)) {
+                cacheApp(QFileInfo(path).completeBaseName());
+            }
+            return;
+        }
+        const qint64 now = clock.elapsed();
+        for (auto it = appCachedValues.constBegin(); it != appCachedValues.constEnd(); ++it) {
+            if (!appLastUsed.contains(it.key())) {
+                appLastUsed.insert(it.key(), now);
+            }
+        }
+        evictIdleApps();
+    }
 
-    UniSettingsPrivate(const QString &app, UniSettings::Scope s)
-        : appName(app)
-        , scope(s)
-        , settings(nullptr)
-        , watcher(nullptr)
-        , debounceTimer(nullptr)
-        , ignoreNextChange(false)
+    QVariant appValue(const QString &fileAppName, const QString &key, const QVariant &defaultValue)
     {
-        QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
-        configDir += "/unisettings";
-        QDir dir;
-        dir.mkpath(configDir);
+        const UniSettingsEntries *entries = cacheApp(fileAppName);
+        if (!entries) {
+            return defaultValue;
+        }
+        auto it = std::lower_bound(entries->cbegin(), entries->cend(), key, entryKeyLess);
+        return it != entries->cend() && it->key == key ? it->value : defaultValue;
+    }
+
+#ifdef UNISETTINGS_HAVE_BUS
+    // Apply a write another process announced on the bus, without reading
+    // the file. Only done if our cache holds exactly the file the write was
+    // applied to; otherwise the watcher event that follows diffs it as usual.
+    void applyBusMessage(const UniSettingsBusMessage &message)
+    {
+        const bool ownFile = message.appName == appName;
+        if (scope == UniSettings::ApplicationScope && !ownFile) {
+            return;
+        }
+        // An app that's only fingerprinted is left to the watcher event
+        if (!ownFile && !appCachedValues.contains(message.appName)) {
+            return;
+        }
+        const QString path = ownFile ? configPath : appConfigPath(message.appName);
+        auto known = fingerprints.find(path);
+        if (known == fingerprints.end() || !known->sameStat(message.base)
+            || known->contentHash != message.base.contentHash) {
+            return;
+        }
+        // Our own unflushed writes would be reported as reverted
+        if (ownFile && (!pendingWrites.isEmpty() || batchDepth > 0)) {
+            return;
+        }
+
+        UniSettingsEntries &cached = ownFile ? cachedValues : appCachedValues[message.appName];
+        UniSettingsEntries updated = cached;
+        for (const UniSettingsBusMessage::Op &op : message.ops) {
+            switch (op.type) {
+            case UniSettingsBusMessage::Set: {
+                auto it = std::lower_bound(updated.begin(), updated.end(), op.key, entryKeyLess);
+                if (it != updated.end() && it->key == op.key) {
+                    it->raw = op.raw;
+                } else {
+                    updated.insert(it, UniSettingsEntry{op.key, op.raw, QVariant()});
+                }
+                break;
+            }
+            case UniSettingsBusMessage::Remove:
+                updated.removeIf([&op](const UniSettingsEntry &entry) {
+                    return isSameOrChildKey(entry.key, op.key);
+                });
+                break;
+            case UniSettingsBusMessage::Clear:
+                updated.clear();
+                break;
+            }
+        }
+        *known = message.written;
+        ++metrics.busUpdates;
+        const QHash<QString, QVariant> changes = mergeEntries(cached, std::move(updated));
+        if (changes.isEmpty()) {
+            return;
+        }
+
+        if (ownFile) {
+            publishSnapshot();
+        }
         if (scope == UniSettings::SystemScope) {
-            configPath = configDir + "/system.conf";
-        } else {
-            configPath = configDir + "/" + appName + ".conf";
+            publishShared();
         }
-        settings = new QSettings(configPath, QSettings::IniFormat);
-        cacheAllValues();
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        notifyExternalChanges(message.appName, changes,
+                              scope == UniSettings::ApplicationScope);
+        if (ownFile) {
+            dispatchChanges(changes);
+        }
+    }
+#endif
+
+    // Changes read from a file: one changesApplied() per instance, preceded
+    // by the per-key signals unless the instance turned them off
+    void notifyExternalChanges(const QString &fileAppName, const QHash<QString, QVariant> &changes,
+                               bool alsoValueChanged)
+    {
+        notifyInstances([&fileAppName, &changes, alsoValueChanged](UniSettings *instance) {
+            if (instance->perKeySignalsEnabled()) {
+                for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+                    if (alsoValueChanged) {
+                        emit instance->valueChanged(it.key(), it.value());
+                    }
+                    emit instance->externalValueChanged(fileAppName, it.key(), it.value());
+                }
+            }
+            emit instance->changesApplied(fileAppName, changes);
+        });
     }
 
-    ~UniSettingsPrivate()
+    // Run the subscriptions on the key's path, after the signals went out
+    void dispatchChange(const QString &key, const QVariant &value)
     {
-        delete settings;
-        delete watcher;
-        delete debounceTimer;
+        if (subscriptions.isEmpty()) {
+            return;
+        }
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        subscriptions.dispatch(key, value);
     }
 
-    QString fullKey(const QString &key) const
+    void dispatchChanges(const QHash<QString, QVariant> &changes)
     {
-        if (currentGroup.isEmpty()) {
-            return key;
+        if (subscriptions.isEmpty()) {
+            return;
+        }
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+            subscriptions.dispatch(it.key(), it.value());
         }
-        return currentGroup + "/" + key;
     }
 
-    void cacheAllValues()
+    // Hand the raw values of system.conf and every app config, keyed
+    // "<appname>/<key>", to the shared memory segment (system scope only)
+    void publishShared()
     {
-        cachedValues.clear();
-        QStringList keys = settings->allKeys();
-        for (const QString &key : keys) {
-            cachedValues[key] = settings->value(key);
+#ifdef UNISETTINGS_HAVE_SHARED_SNAPSHOT
+        QMap<QString, QByteArray> rawValues;
+        for (const UniSettingsEntry &entry : std::as_const(cachedValues)) {
+            rawValues.insert("system/" + entry.key, entry.raw);
+        }
+        for (auto it = appCachedValues.constBegin(); it != appCachedValues.constEnd(); ++it) {
+            for (const UniSettingsEntry &entry : it.value()) {
+                rawValues.insert(it.key() + "/" + entry.key, entry.raw);
+            }
         }
+        sharedPublisher.publish(rawValues);
+#endif
     }
 
-    QHash<QString, QVariant> detectChanges()
+    // Views are only refreshed on watcher events, and the
+    // QFileSystemWatcher backend only reports files it was given. Owner
+    // thread only, starting the watcher if the load hasn't.
+    void watchView(const QString &viewAppName)
     {
-        QHash<QString, QVariant> changes;
-        if (ignoreNextChange) {
-            ignoreNextChange = false;
-            return changes;
+        start();
+        const QString path = QFileInfo(configPath).absolutePath() + "/" + viewAppName + ".conf";
+        if (path == configPath || viewedPaths.contains(path)) {
+            return;
         }
+        viewedPaths.insert(path);
+        s_viewRegistry->retain(viewAppName);
+        watcher->watchFile(path);
+    }
 
-        settings->sync();
-        QStringList currentKeys = settings->allKeys();
-        QSet<QString> currentKeySet(currentKeys.begin(), currentKeys.end());
-        QStringList cachedKeysList = cachedValues.keys();
-        QSet<QString> cachedKeySet(cachedKeysList.begin(), cachedKeysList.end());
+    void onFileChanged(const QString &path)
+    {
+        s_viewRegistry->invalidate(path);
 
-        for (const QString &key : currentKeys) {
-            QVariant newValue = settings->value(key);
-            QVariant oldValue = cachedValues.value(key);
-            if (!cachedValues.contains(key) || newValue != oldValue) {
-                changes[key] = newValue;
-                cachedValues[key] = newValue;
+        // Re-arm watches for views whose file was replaced or created
+        if (viewedPaths.contains(path)) {
+            watcher->watchFile(path);
+        } else if (path == QFileInfo(configPath).absolutePath()) {
+            for (const QString &viewedPath : std::as_const(viewedPaths)) {
+                watcher->watchFile(viewedPath);
             }
         }
 
-        QSet<QString> removedKeys = cachedKeySet - currentKeySet;
-        for (const QString &key : removedKeys) {
-            changes[key] = QVariant();
-            cachedValues.remove(key);
+        // Only watching for the registry so far; the load reads our file
+        if (loadState == Unloaded) {
+            return;
         }
 
-        return changes;
+        // The inotify backend reports every config in the directory
+        if (scope == UniSettings::ApplicationScope && path != configPath
+            && path != QFileInfo(configPath).absolutePath()) {
+            return;
+        }
+        dirtyPaths.insert(path);
+        if (!debounceTimer->isActive()) {
+            debounceTimer->start();
+        }
     }
 
-    // Detect changes for a specific app config (system scope only)
-    QHash<QString, QVariant> detectAppChanges(const QString &appConfigPath, const QString &appName)
+    void processSystemChanges()
     {
-        QHash<QString, QVariant> changes;
-        QSettings appSettings(appConfigPath, QSettings::IniFormat);
-        
-        QStringList currentKeys = appSettings.allKeys();
-        QSet<QString> currentKeySet(currentKeys.begin(), currentKeys.end());
-        
-        QHash<QString, QVariant> &cached = appCachedValues[appName];
-        QStringList cachedKeysList = cached.keys();
-        QSet<QString> cachedKeySet(cachedKeysList.begin(), cachedKeysList.end());
+        // Slots may drop the last instance, and with it this store
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        ensureLoaded();
+        QSet<QString> dirty;
+        dirty.swap(dirtyPaths);
 
-        for (const QString &key : currentKeys) {
-            QVariant newValue = appSettings.value(key);
-            QVariant oldValue = cached.value(key);
-            if (!cached.contains(key) || newValue != oldValue) {
-                changes[key] = newValue;
-                cached[key] = newValue;
+        // A directory event only says the listing changed; pick up configs
+        // that appeared or vanished, edited ones report themselves
+        QString configDir = QFileInfo(configPath).absolutePath();
+        if (dirty.remove(configDir)) {
+            QSet<QString> current;
+            QDir dir(configDir);
+            QStringList filters;
+            filters << "*.conf";
+            QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
+            for (const QFileInfo &fileInfo : files) {
+                QString filePath = fileInfo.absoluteFilePath();
+                if (filePath != configPath) {
+                    current.insert(filePath);
+                }
             }
+            dirty += current - knownAppFiles;
+            dirty += knownAppFiles - current;
+            // system.conf may have been created or deleted; one stat decides
+            dirty.insert(configPath);
         }
 
-        QSet<QString> removedKeys = cachedKeySet - currentKeySet;
-        for (const QString &key : removedKeys) {
-            changes[key] = QVariant();
-            cached.remove(key);
+        // Check system.conf changes
+        bool systemChanged = false;
+        if (dirty.remove(configPath)) {
+            QHash<QString, QVariant> changes = detectChanges();
+            systemChanged = !changes.isEmpty();
+            if (systemChanged) {
+                notifyExternalChanges("system", changes, false);
+                dispatchChanges(changes);
+            }
+
+            // Re-arm the watch if system.conf was replaced
+            watcher->watchFile(configPath);
         }
 
-        return changes;
-    }
-};
+        bool appsChanged = false;
+        for (const QString &filePath : std::as_const(dirty)) {
+            QString appName = QFileInfo(filePath).completeBaseName();
+            bool appChanged;
+            QHash<QString, QVariant> appChanges = detectAppChanges(filePath, appName, &appChanged);
+            if (appChanged) {
+                appsChanged = true;
+                notifyExternalChanges(appName, appChanges, false);
+            }
 
-static UniSettings *s_instance = nullptr;
-static QMutex s_mutex;
+            if (QFileInfo::exists(filePath)) {
+                knownAppFiles.insert(filePath);
+                watcher->watchFile(filePath);
+            } else {
+                knownAppFiles.remove(filePath);
+                appsChanged = appCachedValues.remove(appName) || appsChanged;
+                appLastUsed.remove(appName);
+                fingerprints.remove(filePath);
+            }
+        }
 
-UniSettings* UniSettings::instance()
-{
-    if (!s_instance) {
-        QMutexLocker locker(&s_mutex);
-        if (!s_instance) {
-            s_instance = new UniSettings(nullptr);
+        if (appsChanged || systemChanged) {
+            publishShared();
         }
     }
-    return s_instance;
-}
 
-UniSettings::UniSettings(QObject *parent)
-    : QObject(parent)
-    , d_ptr(new UniSettingsPrivate("system", SystemScope))
-{
-    Q_D(UniSettings);
-    
-    d->watcher = new QFileSystemWatcher(this);
-    QFileInfo fileInfo(d->configPath);
-    
-    // Watch system.conf if it exists
-    if (fileInfo.exists()) {
-        if (!d->watcher->addPath(d->configPath)) {
-            qWarning() << "Failed to watch config file:" << d->configPath;
-        }
-    }
-
-    QString configDir = fileInfo.absolutePath();
-    if (QFileInfo(configDir).exists()) {
-        d->watcher->addPath(configDir);
-        
-        // Watch all existing .conf files for system scope
-        QDir dir(configDir);
-        QStringList filters;
-        filters << "*.conf";
-        QFileInfoList configFiles = dir.entryInfoList(filters, QDir::Files);
-        for (const QFileInfo &configFile : configFiles) {
-            QString filePath = configFile.absoluteFilePath();
-            if (filePath != d->configPath && !d->watcher->files().contains(filePath)) {
-                d->watcher->addPath(filePath);
-                // Initialize cache for this app
-                QString appName = configFile.baseName();
-                d->detectAppChanges(filePath, appName);
-            }
+    void processApplicationChanges()
+    {
+        const std::shared_ptr<UniSettingsStore> keepAlive = shared_from_this();
+        ensureLoaded();
+        // Only our own file matters here, directory events included
+        dirtyPaths.clear();
+        QHash<QString, QVariant> changes = detectChanges();
+        if (!changes.isEmpty()) {
+            // valueChanged too, for local monitoring
+            notifyExternalChanges(appName, changes, true);
+            dispatchChanges(changes);
         }
-    }
 
-    d->debounceTimer = new QTimer(this);
-    d->debounceTimer->setSingleShot(true);
-    d->debounceTimer->setInterval(100);
+        watcher->watchFile(configPath);
+    }
+};
 
-    connect(d->watcher, &QFileSystemWatcher::fileChanged,
-            this, &UniSettings::onFileChanged);
-    connect(d->watcher, &QFileSystemWatcher::directoryChanged,
-            this, &UniSettings::onFileChanged);
+// Per-object state; everything else lives in the shared store
+class UniSettingsPrivate
+{
+public:
+    std::shared_ptr<UniSettingsStore> store;
+    QString currentGroup;
+    bool perKeySignals = true;
+    // trackApp() calls not yet undone, released with the object
+    QStringList trackedApps;
+    // This object's share of the store's batchDepth, given back if it is
+    // destroyed before committing
+    int batchDepth = 0;
 
-    connect(d->debounceTimer, &QTimer::timeout, this, [this]() {
-        Q_D(UniSettings);
-        
-        // Check system.conf changes
-        QHash<QString, QVariant> changes = d->detectChanges();
-        for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
-            emit externalValueChanged("system", it.key(), it.value());
-        }
-
-        // Check all app configs in directory
-        QString configDir = QFileInfo(d->configPath).absolutePath();
-        QDir dir(configDir);
-        QStringList filters;
-        filters << "*.conf";
-        QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
-        
-        for (const QFileInfo &fileInfo : files) {
-            QString appName = fileInfo.baseName();
-            QString filePath = fileInfo.absoluteFilePath();
-            
-            if (appName != "system") {
-                QHash<QString, QVariant> appChanges = d->detectAppChanges(filePath, appName);
-                for (auto it = appChanges.constBegin(); it != appChanges.constEnd(); ++it) {
-                    emit externalValueChanged(appName, it.key(), it.value());
-                }
-                
-                // Add to watcher if not already watched
-                if (!d->watcher->files().contains(filePath)) {
-                    d->watcher->addPath(filePath);
-                }
-            }
+    // Normalized like QSettings does; an empty key is the group itself
+    QString fullKey(const QString &key) const
+    {
+        const QString normalized = UniIniFile::normalizedKey(key);
+        if (currentGroup.isEmpty()) {
+            return normalized;
+        }
+        if (normalized.isEmpty()) {
+            return currentGroup;
         }
+        return currentGroup + "/" + normalized;
+    }
+};
 
-        // Re-add system.conf if removed
-        if (!d->watcher->files().contains(d->configPath)) {
-            QFileInfo fileInfo(d->configPath);
-            if (fileInfo.exists()) {
-                d->watcher->addPath(d->configPath);
+// Stores in use, by scope, thread and app name. A store owns timers and a
+// watcher, so instances only share one with others on the same thread.
+static QMutex s_storesMutex;
+static QHash<QString, std::weak_ptr<UniSettingsStore>> s_stores;
+
+// Run from ~QCoreApplication. instance() is never destroyed, so without
+// this its write-behind queue would be lost at exit. Stores of other
+// threads went away with them.
+static void flushStoresAtExit()
+{
+    QList<std::shared_ptr<UniSettingsStore>> stores;
+    {
+        QMutexLocker locker(&s_storesMutex);
+        for (const std::weak_ptr<UniSettingsStore> &weakStore : std::as_const(s_stores)) {
+            std::shared_ptr<UniSettingsStore> store = weakStore.lock();
+            if (store && store->thread() == QThread::currentThread()) {
+                stores.append(std::move(store));
             }
         }
-    });
+    }
+    for (const std::shared_ptr<UniSettingsStore> &store : std::as_const(stores)) {
+        store->flushForExit();
+    }
 }
 
-UniSettings::UniSettings(const QString &appName, QObject *parent)
-    : QObject(parent)
-    , d_ptr(new UniSettingsPrivate(appName, ApplicationScope))
+static std::shared_ptr<UniSettingsStore> acquireStore(const QString &appName, UniSettings::Scope scope)
 {
-    Q_D(UniSettings);
-    
-    d->watcher = new QFileSystemWatcher(this);
-    QFileInfo fileInfo(d->configPath);
-    
-    if (fileInfo.exists()) {
-        if (!d->watcher->addPath(d->configPath)) {
-            qWarning() << "Failed to watch config file:" << d->configPath;
-        }
+    QString storeKey = QString::number(quintptr(QThread::currentThread()), 16);
+    if (scope == UniSettings::SystemScope) {
+        storeKey += ":system";
+    } else {
+        storeKey += "/" + appName;
     }
 
-    QString configDir = fileInfo.absolutePath();
-    if (QFileInfo(configDir).exists()) {
-        d->watcher->addPath(configDir);
+    QMutexLocker locker(&s_storesMutex);
+    static bool flushAtExit = false;
+    if (!flushAtExit) {
+        qAddPostRoutine(flushStoresAtExit);
+        flushAtExit = true;
+    }
+    s_stores.removeIf([](const QHash<QString, std::weak_ptr<UniSettingsStore>>::iterator it) {
+        return it.value().expired();
+    });
+    std::shared_ptr<UniSettingsStore> store = s_stores.value(storeKey).lock();
+    if (!store) {
+        store = std::make_shared<UniSettingsStore>(appName, scope);
+        s_stores.insert(storeKey, store);
     }
+    return store;
+}
 
-    d->debounceTimer = new QTimer(this);
-    d->debounceTimer->setSingleShot(true);
-    d->debounceTimer->setInterval(100);
+static QAtomicPointer<UniSettings> s_instance = nullptr;
+static QMutex s_mutex;
+static std::atomic<UniSettings::LoadMode> s_defaultLoadMode = UniSettings::LoadImmediately;
 
-    connect(d->watcher, &QFileSystemWatcher::fileChanged,
-            this, &UniSettings::onFileChanged);
-    connect(d->watcher, &QFileSystemWatcher::directoryChanged,
-            this, &UniSettings::onFileChanged);
+void UniSettings::setDefaultLoadMode(LoadMode mode)
+{
+    s_defaultLoadMode.store(mode);
+}
 
-    connect(d->debounceTimer, &QTimer::timeout, this, [this]() {
-        Q_D(UniSettings);
-        QHash<QString, QVariant> changes = d->detectChanges();
-        for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
-            emit valueChanged(it.key(), it.value());  // Added for local monitoring
-            emit externalValueChanged(d->appName, it.key(), it.value());
-        }
+UniSettings::LoadMode UniSettings::defaultLoadMode()
+{
+    return s_defaultLoadMode.load();
+}
 
-        if (!d->watcher->files().contains(d->configPath)) {
-            QFileInfo fileInfo(d->configPath);
-            if (fileInfo.exists()) {
-                d->watcher->addPath(d->configPath);
-            }
+UniSettings* UniSettings::instance()
+{
+    UniSettings *instance = s_instance.loadAcquire();
+    if (!instance) {
+        QMutexLocker locker(&s_mutex);
+        instance = s_instance.loadRelaxed();
+        if (!instance) {
+            instance = new UniSettings(nullptr);
+            s_instance.storeRelease(instance);
         }
-    });
+    }
+    return instance;
+}
+
+UniSettings::UniSettings(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new UniSettingsPrivate)
+{
+    Q_D(UniSettings);
+    d->store = acquireStore("system", SystemScope);
+    d->store->instances.append(this);
+    d->store->requestLoad(defaultLoadMode());
+}
+
+UniSettings::UniSettings(const QString &appName, QObject *parent)
+    : UniSettings(appName, defaultLoadMode(), parent)
+{
+}
+
+UniSettings::UniSettings(const QString &appName, LoadMode loadMode, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new UniSettingsPrivate)
+{
+    Q_D(UniSettings);
+    d->store = acquireStore(appName, ApplicationScope);
+    d->store->instances.append(this);
+    d->store->requestLoad(loadMode);
 }
 
 UniSettings::~UniSettings()
 {
+    Q_D(UniSettings);
+    for (const QString &appName : std::as_const(d->trackedApps)) {
+        d->store->untrackApp(appName);
+    }
+    d->store->instances.removeOne(this);
+    if (d->batchDepth > 0) {
+        d->store->batchDepth -= d->batchDepth;
+        if (d->store->batchDepth == 0) {
+            d->store->finishBatch();
+        }
+    }
 }
 
 QVariant UniSettings::value(const QString &key, const QVariant &defaultValue) const
 {
     Q_D(const UniSettings);
-    return d->settings->value(d->fullKey(key), defaultValue);
+    d->store->ensureLoaded();
+    const UniSettingsEntry *entry = d->store->cachedValue(d->fullKey(key));
+    return entry ? entry->value : defaultValue;
 }
 
 void UniSettings::setValue(const QString &key, const QVariant &value)
 {
     Q_D(UniSettings);
-    QString fullKey = d->fullKey(key);
-    QVariant oldValue = d->settings->value(fullKey);
-    if (oldValue != value) {
-        d->ignoreNextChange = true;
-        d->settings->setValue(fullKey, value);
-        d->settings->sync();
-        d->cachedValues[fullKey] = value;
-        emit valueChanged(fullKey, value);
+    // Slots may delete this instance; only the store is used after emitting
+    const std::shared_ptr<UniSettingsStore> store = d->store;
+    store->ensureLoaded();
+    const QString fullKey = d->fullKey(key);
+    const UniSettingsEntry *old = store->cachedValue(fullKey);
+    if (!old || old->value != value) {
+        store->setCachedValue(fullKey, value);
+        store->invalidateSnapshot();
+        store->scheduleWrite({PendingWrite::Set, fullKey, value});
+        if (store->batchDepth > 0) {
+            store->batchChanges.insert(fullKey, value);
+        } else {
+            store->notifyInstances([&fullKey, &value](UniSettings *instance) {
+                emit instance->valueChanged(fullKey, value);
+            });
+            store->dispatchChange(fullKey, value);
+        }
     }
 }
 
 bool UniSettings::contains(const QString &key) const
 {
     Q_D(const UniSettings);
-    return d->settings->contains(d->fullKey(key));
+    d->store->ensureLoaded();
+    return d->store->cachedValue(d->fullKey(key)) != nullptr;
 }
 
 void UniSettings::remove(const QString &key)
 {
     Q_D(UniSettings);
-    QString fullKey = d->fullKey(key);
-    d->ignoreNextChange = true;
-    d->settings->remove(fullKey);
-    d->settings->sync();
-    d->cachedValues.remove(fullKey);
-    emit valueChanged(fullKey, QVariant());
+    // Slots may delete this instance; only the store is used after emitting
+    const std::shared_ptr<UniSettingsStore> store = d->store;
+    store->ensureLoaded();
+    const QString fullKey = d->fullKey(key);
+    QVariantHash changes = store->removeCachedKey(fullKey);
+    store->invalidateSnapshot();
+    store->scheduleWrite({PendingWrite::Remove, fullKey, QVariant()});
+    // A single key, set or not, is reported as such; a group reports
+    // every key that was in it, like clear() does
+    const bool singleKey = changes.isEmpty() || (changes.size() == 1 && changes.contains(fullKey));
+    if (singleKey) {
+        changes = {{fullKey, QVariant()}};
+    }
+    if (store->batchDepth > 0) {
+        store->batchChanges.insert(changes);
+    } else if (singleKey) {
+        store->notifyInstances([&fullKey](UniSettings *instance) {
+            emit instance->valueChanged(fullKey, QVariant());
+        });
+        store->dispatchChange(fullKey, QVariant());
+    } else {
+        store->notifyLocalChanges(changes);
+    }
 }
 
 QStringList UniSettings::allKeys() const
 {
     Q_D(const UniSettings);
-    return d->settings->allKeys();
+    d->store->ensureLoaded();
+    // The cache is kept sorted by key
+    QStringList keys;
+    keys.reserve(d->store->cachedValues.size());
+    for (const UniSettingsEntry &entry : std::as_const(d->store->cachedValues)) {
+        keys.append(entry.key);
+    }
+    return keys;
 }
 
 void UniSettings::clear()
 {
     Q_D(UniSettings);
-    d->ignoreNextChange = true;
-    d->settings->clear();
-    d->settings->sync();
-    d->cachedValues.clear();
+    // Slots may delete this instance; only the store is used after emitting
+    const std::shared_ptr<UniSettingsStore> store = d->store;
+    store->ensureLoaded();
+    // Every key is reported removed, so listeners fall back to defaults
+    QVariantHash changes;
+    changes.reserve(store->cachedValues.size());
+    for (const UniSettingsEntry &entry : std::as_const(store->cachedValues)) {
+        changes.insert(entry.key, QVariant());
+    }
+    store->cachedValues.clear();
+    store->invalidateSnapshot();
+    store->scheduleWrite({PendingWrite::Clear, QString(), QVariant()});
+    if (store->batchDepth > 0) {
+        store->batchChanges.insert(changes);
+    } else {
+        store->notifyLocalChanges(changes);
+    }
 }
 
 void UniSettings::sync()
 {
     Q_D(UniSettings);
-    d->settings->sync();
+    d->store->flush();
 }
 
-void UniSettings::beginGroup(const QString &prefix)
+void UniSettings::beginBatch()
 {
     Q_D(UniSettings);
-    if (!d->currentGroup.isEmpty()) {
-        d->currentGroup += "/" + prefix;
-    } else {
-        d->currentGroup = prefix;
+    ++d->batchDepth;
+    ++d->store->batchDepth;
+}
+
+void UniSettings::commitBatch()
+{
+    Q_D(UniSettings);
+    if (d->batchDepth == 0) {
+        qWarning() << "UniSettings::commitBatch() called without beginBatch()";
+        return;
+    }
+    --d->batchDepth;
+    if (--d->store->batchDepth > 0) {
+        return;
+    }
+    // Slots may delete this instance; d is not touched after this
+    d->store->finishBatch();
+}
+
+bool UniSettings::isBatchActive() const
+{
+    Q_D(const UniSettings);
+    return d->store->batchDepth > 0;
+}
+
+void UniSettings::setWriteDelay(int msec)
+{
+    Q_D(UniSettings);
+    d->store->writeDelay = msec;
+    if (msec <= 0) {
+        d->store->flush();
     }
 }
 
+int UniSettings::writeDelay() const
+{
+    Q_D(const UniSettings);
+    return d->store->writeDelay;
+}
+
+void UniSettings::setPerKeySignalsEnabled(bool enabled)
+{
+    Q_D(UniSettings);
+    d->perKeySignals = enabled;
+}
+
+bool UniSettings::perKeySignalsEnabled() const
+{
+    Q_D(const UniSettings);
+    return d->perKeySignals;
+}
+
+void UniSettings::beginGroup(const QString &prefix)
+{
+    Q_D(UniSettings);
+    d->currentGroup = d->fullKey(prefix);
+}
+
 void UniSettings::endGroup()
 {
     Q_D(UniSettings);
@@ -375,41 +1852,191 @@ QString UniSettings::group() const
 QVariant UniSettings::systemValue(const QString &key, const QVariant &defaultValue) const
 {
     Q_D(const UniSettings);
-    if (d->scope == SystemScope) {
+    if (d->store->scope == SystemScope) {
         return value(key, defaultValue);
     }
 
-    QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
-    QString systemConfigPath = configDir + "/unisettings/system.conf";
-    QSettings systemSettings(systemConfigPath, QSettings::IniFormat);
-    return systemSettings.value(key, defaultValue);
+    if (QThread::currentThread() == thread()) {
+        d->store->watchView(QStringLiteral("system"));
+    }
+    return s_viewRegistry->value("system", UniIniFile::normalizedKey(key), defaultValue);
 }
 
 QVariant UniSettings::appValue(const QString &appName, const QString &key, const QVariant &defaultValue) const
 {
-    QString configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
-    QString appConfigPath = configDir + "/unisettings/" + appName + ".conf";
-    QSettings appSettings(appConfigPath, QSettings::IniFormat);
-    return appSettings.value(key, defaultValue);
+    Q_D(const UniSettings);
+    // The system scope keeps app configs itself; reading one marks it used
+    if (d->store->scope == SystemScope && appName != QLatin1String("system")) {
+        d->store->ensureLoaded();
+        return d->store->appValue(appName, UniIniFile::normalizedKey(key), defaultValue);
+    }
+
+    if (QThread::currentThread() == thread()) {
+        d->store->watchView(appName);
+    }
+    return s_viewRegistry->value(appName, UniIniFile::normalizedKey(key), defaultValue);
+}
+
+void UniSettings::trackApp(const QString &appName)
+{
+    Q_D(UniSettings);
+    if (d->store->scope != SystemScope) {
+        qWarning() << "UniSettings::trackApp() is only available in system scope";
+        return;
+    }
+    d->store->ensureLoaded();
+    d->store->trackApp(appName);
+    d->trackedApps.append(appName);
+}
+
+void UniSettings::untrackApp(const QString &appName)
+{
+    Q_D(UniSettings);
+    if (d->trackedApps.removeOne(appName)) {
+        d->store->untrackApp(appName);
+    }
+}
+
+void UniSettings::setAppIdleTimeout(int msec)
+{
+    Q_D(UniSettings);
+    d->store->setAppIdleTimeout(msec);
+}
+
+int UniSettings::appIdleTimeout() const
+{
+    Q_D(const UniSettings);
+    return d->store->appIdleTimeout;
+}
+
+int UniSettings::subscribe(const QString &prefix, QObject *receiver, ChangeHandler handler)
+{
+    Q_D(UniSettings);
+    UniSettingsStore *store = d->store.get();
+    // Changes are only seen once the files are
+    store->ensureLoaded();
+    const int id = store->subscriptions.add(d->fullKey(prefix), receiver, std::move(handler));
+    if (receiver) {
+        connect(receiver, &QObject::destroyed, store, [store, id]() {
+            store->subscriptions.remove(id);
+        });
+    }
+    return id;
+}
+
+void UniSettings::unsubscribe(int id)
+{
+    Q_D(UniSettings);
+    d->store->subscriptions.remove(id);
+}
+
+UniSettings::Metrics UniSettings::metrics() const
+{
+    Q_D(const UniSettings);
+    Metrics metrics = d->store->metrics;
+    metrics.sharedReads = s_viewRegistry->sharedReadCount();
+    return metrics;
+}
+
+UniSettings::Snapshot UniSettings::snapshot() const
+{
+    Q_D(const UniSettings);
+    // Loading touches the store's timers and watcher, so only the owner
+    // does it; other threads get a null snapshot until it has. The owner
+    // also publishes its own writes first, other threads see them once
+    // the event loop or the batch gets to it.
+    if (QThread::currentThread() == thread()) {
+        d->store->ensureLoaded();
+        d->store->publishStaleSnapshot();
+    }
+    return Snapshot(d->store->snapshots.acquire());
 }
 
 QString UniSettings::applicationName() const
 {
     Q_D(const UniSettings);
-    return d->appName;
+    return d->store->appName;
 }
 
 UniSettings::Scope UniSettings::scope() const
 {
     Q_D(const UniSettings);
-    return d->scope;
+    return d->store->scope;
 }
 
-void UniSettings::onFileChanged(const QString &path)
+void UniSettings::connectNotify(const QMetaMethod &signal)
 {
     Q_D(UniSettings);
-    Q_UNUSED(path);
-    if (!d->debounceTimer->isActive()) {
-        d->debounceTimer->start();
+    // A connection is a reader too, of changes. QObject's own signals don't
+    // count, and a connect from another thread leaves it to the owner.
+    if (signal.enclosingMetaObject() == &UniSettings::staticMetaObject
+        && QThread::currentThread() == thread()) {
+        d->store->ensureLoaded();
+    }
+}
+
+UniSettings::Snapshot::Snapshot()
+    : d(nullptr)
+{
+}
+
+UniSettings::Snapshot::Snapshot(UniSettingsSnapshot *data)
+    : d(data)
+{
+}
+
+UniSettings::Snapshot::Snapshot(const Snapshot &other)
+    : d(other.d)
+{
+    if (d) {
+        d->ref.fetch_add(1);
+    }
+}
+
+UniSettings::Snapshot::Snapshot(Snapshot &&other) noexcept
+    : d(std::exchange(other.d, nullptr))
+{
+}
+
+UniSettings::Snapshot &UniSettings::Snapshot::operator=(const Snapshot &other)
+{
+    Snapshot copy(other);
+    std::swap(d, copy.d);
+    return *this;
+}
+
+UniSettings::Snapshot &UniSettings::Snapshot::operator=(Snapshot &&other) noexcept
+{
+    std::swap(d, other.d);
+    return *this;
+}
+
+UniSettings::Snapshot::~Snapshot()
+{
+    UniSettingsSnapshot::release(d);
+}
+
+bool UniSettings::Snapshot::isNull() const
+{
+    return !d;
+}
+
+QVariant UniSettings::Snapshot::value(const QString &key, const QVariant &defaultValue) const
+{
+    return d ? d->values.value(key, defaultValue) : defaultValue;
+}
+
+bool UniSettings::Snapshot::contains(const QString &key) const
+{
+    return d && d->values.contains(key);
+}
+
+QStringList UniSettings::Snapshot::allKeys() const
+{
+    if (!d) {
+        return QStringList();
     }
+    QStringList keys = d->values.keys();
+    keys.sort();
+    return keys;
 }
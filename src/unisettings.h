@@ -6,9 +6,11 @@
 #include <QString>
 #include <QVariant>
 #include <QStringList>
+#include <functional>
 #include <memory>
 
 class UniSettingsPrivate;
+struct UniSettingsSnapshot;
 
 class UNISETTINGS_EXPORT UniSettings : public QObject
 {
@@ -20,8 +22,56 @@ public:
         ApplicationScope    // app settings
     };
 
+    // Immutable view of all keys. Taking and reading one is lock-free and
+    // safe from any thread; everything else is for the owning thread only.
+    class UNISETTINGS_EXPORT Snapshot
+    {
+    public:
+        Snapshot();
+        Snapshot(const Snapshot &other);
+        Snapshot(Snapshot &&other) noexcept;
+        Snapshot &operator=(const Snapshot &other);
+        Snapshot &operator=(Snapshot &&other) noexcept;
+        ~Snapshot();
+
+        bool isNull() const;
+        QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+        bool contains(const QString &key) const;
+        QStringList allKeys() const;
+
+    private:
+        friend class UniSettings;
+        explicit Snapshot(UniSettingsSnapshot *data);
+
+        UniSettingsSnapshot *d;
+    };
+
+    // Counters for the change detection path
+    struct Metrics
+    {
+        quint64 fileChecks = 0;     // files looked at after watcher events
+        quint64 diffsSkipped = 0;   // of those, skipped by fingerprint
+        quint64 sharedReads = 0;    // appValue()/systemValue() answered from
+                                    // shared memory, process-wide
+        quint64 busUpdates = 0;     // other processes' writes applied from
+                                    // the bus without reading the file
+    };
+
+    // When an instance reads its config file (and, in system scope, every
+    // app config): in the constructor, on the first read, write, subscribe()
+    // or signal connection, or on a pool thread started by the constructor,
+    // in which case an early read waits only for a load already underway
+    enum LoadMode {
+        LoadImmediately,
+        LoadOnDemand,
+        LoadInBackground
+    };
+
+    using ChangeHandler = std::function<void(const QString &key, const QVariant &value)>;
+
     static UniSettings* instance();
     explicit UniSettings(const QString &appName, QObject *parent = nullptr);
+    UniSettings(const QString &appName, LoadMode loadMode, QObject *parent = nullptr);
     ~UniSettings();
 
     QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
@@ -32,6 +82,20 @@ public:
     void clear();
     void sync();
 
+    // write-behind: coalesce writes into one file rewrite per window (0 = write-through)
+    void setWriteDelay(int msec);
+    int writeDelay() const;
+
+    // collect writes and publish them with a single file write on commit
+    void beginBatch();
+    void commitBatch();
+    bool isBatchActive() const;
+
+    // off: external changes and committed batches only emit changesApplied()
+    // and valuesChanged(), not valueChanged()/externalValueChanged() per key
+    void setPerKeySignalsEnabled(bool enabled);
+    bool perKeySignalsEnabled() const;
+
     void beginGroup(const QString &prefix);
     void endGroup();
     QString group() const;
@@ -40,12 +104,50 @@ public:
     QVariant systemValue(const QString &key, const QVariant &defaultValue = QVariant()) const;
     QVariant appValue(const QString &appName, const QString &key, const QVariant &defaultValue = QVariant()) const;
 
+    // system scope: keep an app's contents cached so its changes are
+    // reported key by key; counted, undone by untrackApp() or destruction
+    void trackApp(const QString &appName);
+    void untrackApp(const QString &appName);
+    // system scope: cache only apps tracked or read through appValue() in
+    // the last msec; the others emit changesApplied() with no keys when
+    // their file changes (-1 = cache every app, the default)
+    void setAppIdleTimeout(int msec);
+    int appIdleTimeout() const;
+
+    // call handler for changes to prefix or any key below it, local or
+    // external; prefixes are whole key segments relative to the current
+    // group ("" = everything). Lasts until unsubscribe() or receiver dies.
+    int subscribe(const QString &prefix, QObject *receiver, ChangeHandler handler);
+    template <typename Receiver>
+    int subscribe(const QString &prefix, Receiver *receiver,
+                  void (Receiver::*slot)(const QString &, const QVariant &))
+    {
+        return subscribe(prefix, receiver, [receiver, slot](const QString &key, const QVariant &value) {
+            (receiver->*slot)(key, value);
+        });
+    }
+    void unsubscribe(int id);
+
+    // On other threads than the owner's, null until the owner has loaded
+    Snapshot snapshot() const;
+    Metrics metrics() const;
+
     QString applicationName() const;
     Scope scope() const;
 
+    // used by instance() and constructors not given a mode; default LoadImmediately
+    static void setDefaultLoadMode(LoadMode mode);
+    static LoadMode defaultLoadMode();
+
 signals:
     void valueChanged(const QString &key, const QVariant &value);
+    void valuesChanged(const QVariantHash &changes);
     void externalValueChanged(const QString &appName, const QString &key, const QVariant &value);
+    // every key one debounce window (or bus message) brought in for a file
+    void changesApplied(const QString &appName, const QVariantHash &changes);
+
+protected:
+    void connectNotify(const QMetaMethod &signal) override;
 
 private:
     explicit UniSettings(QObject *parent = nullptr); // singleton constr
@@ -54,9 +156,6 @@ private:
 
     std::unique_ptr<UniSettingsPrivate> d_ptr;
     Q_DECLARE_PRIVATE(UniSettings)
-
-private slots:
-    void onFileChanged(const QString &path);
 };
 
 #endif // UNISETTINGS_H
\ No newline at end of file
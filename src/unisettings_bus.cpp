@@ -0,0 +1,171 @@
+#include "unisettings_bus.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QIODevice>
+#include <QPointer>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const quint32 s_version = 1;
+
+QDataStream &operator<<(QDataStream &stream, const UniFileFingerprint &fingerprint)
+{
+    return stream << fingerprint.exists << fingerprint.size << fingerprint.mtimeNs
+                  << fingerprint.inode << quint64(fingerprint.contentHash);
+}
+
+QDataStream &operator>>(QDataStream &stream, UniFileFingerprint &fingerprint)
+{
+    quint64 contentHash;
+    stream >> fingerprint.exists >> fingerprint.size >> fingerprint.mtimeNs
+           >> fingerprint.inode >> contentHash;
+    fingerprint.contentHash = size_t(contentHash);
+    return stream;
+}
+
+} // namespace
+
+QByteArray UniSettingsBusMessage::serialize() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << s_version << appName << base << written << quint32(ops.size());
+    for (const Op &op : ops) {
+        stream << quint8(op.type) << op.key << op.raw;
+    }
+    return data;
+}
+
+bool UniSettingsBusMessage::parse(const QByteArray &data, UniSettingsBusMessage *message)
+{
+    QDataStream stream(data);
+    quint32 version;
+    quint32 opCount;
+    stream >> version;
+    if (version != s_version) {
+        return false;
+    }
+    stream >> message->appName >> message->base >> message->written >> opCount;
+    message->ops.clear();
+    for (quint32 i = 0; i < opCount && stream.status() == QDataStream::Ok; ++i) {
+        quint8 type;
+        Op op;
+        stream >> type >> op.key >> op.raw;
+        if (type > Clear) {
+            return false;
+        }
+        op.type = OpType(type);
+        message->ops.append(op);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+UniSettingsBus::UniSettingsBus(QObject *parent)
+    : QObject(parent)
+{
+    connectToBroker();
+}
+
+UniSettingsBus::~UniSettingsBus()
+{
+    disconnectFromBroker();
+}
+
+QString UniSettingsBus::socketPath()
+{
+    const QString path = qEnvironmentVariable("UNISETTINGS_BUS_SOCKET");
+    if (!path.isEmpty()) {
+        return path;
+    }
+    return QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + "/unisettings-bus";
+}
+
+bool UniSettingsBus::connectToBroker()
+{
+    const QByteArray path = QFile::encodeName(socketPath());
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= qsizetype(sizeof(address.sun_path))) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.constData(), path.size());
+
+    // Datagram-like framing over a reliable, ordered connection
+    m_fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (::connect(m_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &UniSettingsBus::readMessages);
+    return true;
+}
+
+void UniSettingsBus::disconnectFromBroker()
+{
+    // May run from the notifier's own activated() signal
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+        m_notifier->deleteLater();
+        m_notifier = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void UniSettingsBus::publish(const UniSettingsBusMessage &message)
+{
+    // The broker may have been started after us
+    if (m_fd < 0 && !connectToBroker()) {
+        return;
+    }
+    const QByteArray data = message.serialize();
+    if (::send(m_fd, data.constData(), data.size(), MSG_NOSIGNAL) < 0
+        && errno != EAGAIN && errno != EWOULDBLOCK && errno != EMSGSIZE) {
+        disconnectFromBroker();
+    }
+}
+
+void UniSettingsBus::readMessages()
+{
+    for (;;) {
+        // MSG_TRUNC makes a peek report the full length of the next message
+        const ssize_t size = ::recv(m_fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+        if (size <= 0) {
+            if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                disconnectFromBroker();
+            }
+            return;
+        }
+        QByteArray data(size, Qt::Uninitialized);
+        if (::recv(m_fd, data.data(), data.size(), 0) != size) {
+            disconnectFromBroker();
+            return;
+        }
+
+        UniSettingsBusMessage message;
+        if (UniSettingsBusMessage::parse(data, &message)) {
+            QPointer<UniSettingsBus> guard(this);
+            emit messageReceived(message);
+            // A slot may have deleted us or torn the connection down
+            if (!guard || m_fd < 0) {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef UNISETTINGS_BUS_H
+#define UNISETTINGS_BUS_H
+
+#include "unisettings_ini.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QSocketNotifier;
+
+// One write to a config file as it was applied: the ops in order, plus the
+// file before and after. A receiver whose cache matches `base` can apply
+// the ops and take `written` as the file's new fingerprint, skipping the
+// read the watcher event would otherwise cause.
+struct UniSettingsBusMessage
+{
+    enum OpType : quint8 { Set, Remove, Clear };
+
+    struct Op
+    {
+        OpType type;
+        QString key;
+        QByteArray raw;     // escaped value, Set only
+    };
+
+    QString appName;
+    UniFileFingerprint base;
+    UniFileFingerprint written;
+    QList<Op> ops;
+
+    QByteArray serialize() const;
+    static bool parse(const QByteArray &data, UniSettingsBusMessage *message);
+};
+
+// Connection to the local broker (tools/unisettings-bus), which relays each
+// message to every other connection. Without a broker nothing is sent and
+// file watching alone keeps caches current.
+class UniSettingsBus : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UniSettingsBus(QObject *parent = nullptr);
+    ~UniSettingsBus() override;
+
+    // $UNISETTINGS_BUS_SOCKET, or "unisettings-bus" in the runtime dir
+    static QString socketPath();
+
+    // Best effort: dropped if there's no broker or its queue is full
+    void publish(const UniSettingsBusMessage &message);
+
+signals:
+    void messageReceived(const UniSettingsBusMessage &message);
+
+private:
+    bool connectToBroker();
+    void disconnectFromBroker();
+    void readMessages();
+
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+};
+
+#endif // UNISETTINGS_BUS_H
@@ -0,0 +1,261 @@
+#include "unisettings_db.h"
+
+#include <QList>
+#include <QSaveFile>
+#include <cstring>
+
+namespace {
+
+const char s_magic[8] = {'U', 'N', 'I', 'S', 'D', 'B', '\0', '\0'};
+const quint32 s_version = 1;
+const quint32 s_byteOrderMark = 0x01020304;
+const quint32 s_emptyBucket = 0xffffffff;
+
+// FNV-1a over the UTF-16 code units, so lookups hash the QStringView as is
+quint32 keyHash(QStringView key)
+{
+    quint32 hash = 2166136261u;
+    for (QChar c : key) {
+        hash ^= c.unicode();
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+// File layout, in native byte order:
+//   Header
+//   quint32 table[bucketCount]    record index per bucket, linear probing
+//   Record records[entryCount]    sorted by key
+//   UTF-16 keys, then escaped values, addressed by offsets into the file
+struct UniSettingsDb::Header
+{
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 bucketCount;    // power of two, larger than entryCount
+    quint32 entryCount;
+    qint64 sourceSize;
+    qint64 sourceMtimeNs;
+    quint64 sourceInode;
+    quint64 sourceContentHash;
+};
+
+struct UniSettingsDb::Record
+{
+    quint32 hash;
+    quint32 keyOffset;
+    quint32 keyLength;      // in UTF-16 code units
+    quint32 valueOffset;
+    quint32 valueLength;
+};
+
+UniSettingsDb::UniSettingsDb(const QString &path)
+    : m_file(path)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    m_size = m_file.size();
+    if (m_size < qint64(sizeof(Header))) {
+        return;
+    }
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        return;
+    }
+    validate();
+}
+
+UniSettingsDb::UniSettingsDb(QByteArrayView image)
+    : m_data(reinterpret_cast<const uchar *>(image.data()))
+    , m_size(image.size())
+{
+    if (m_data && m_size >= qint64(sizeof(Header))) {
+        validate();
+    }
+}
+
+// Only the fixed-size parts are checked here; key and value ranges are
+// checked as they're read, so opening stays O(1)
+void UniSettingsDb::validate()
+{
+    static_assert(sizeof(Header) == 56, "Header must not be padded");
+    static_assert(sizeof(Record) == 20, "Record must not be padded");
+
+    const Header *h = header();
+    if (std::memcmp(h->magic, s_magic, sizeof(s_magic)) != 0
+        || h->version != s_version || h->byteOrder != s_byteOrderMark) {
+        return;
+    }
+    if (h->bucketCount == 0 || (h->bucketCount & (h->bucketCount - 1)) != 0
+        || h->entryCount >= h->bucketCount) {
+        return;
+    }
+    const qint64 recordsEnd = qint64(sizeof(Header)) + qint64(h->bucketCount) * 4
+            + qint64(h->entryCount) * qint64(sizeof(Record));
+    if (recordsEnd > m_size) {
+        return;
+    }
+
+    m_bucketMask = h->bucketCount - 1;
+    m_entryCount = h->entryCount;
+}
+
+UniSettingsDb::~UniSettingsDb() = default;
+
+const UniSettingsDb::Header *UniSettingsDb::header() const
+{
+    return reinterpret_cast<const Header *>(m_data);
+}
+
+const UniSettingsDb::Record *UniSettingsDb::record(qsizetype index) const
+{
+    const uchar *records = m_data + sizeof(Header) + qsizetype(m_bucketMask + 1) * 4;
+    return reinterpret_cast<const Record *>(records) + index;
+}
+
+bool UniSettingsDb::isFreshFor(const UniFileFingerprint &source) const
+{
+    if (!isValid() || !source.exists) {
+        return false;
+    }
+    const Header *h = header();
+    return h->sourceSize == source.size && h->sourceMtimeNs == source.mtimeNs
+        && h->sourceInode == source.inode;
+}
+
+size_t UniSettingsDb::sourceContentHash() const
+{
+    return isValid() ? size_t(header()->sourceContentHash) : 0;
+}
+
+QStringView UniSettingsDb::key(qsizetype index) const
+{
+    // Copied out once: anything able to write the file can change the
+    // mapping between the bounds check and the use of what was checked
+    const Record r = *record(index);
+    if (r.keyOffset % 2 != 0 || qint64(r.keyOffset) + qint64(r.keyLength) * 2 > m_size) {
+        return QStringView();
+    }
+    return QStringView(reinterpret_cast<const char16_t *>(m_data + r.keyOffset), r.keyLength);
+}
+
+QByteArrayView UniSettingsDb::rawValue(qsizetype index) const
+{
+    const Record r = *record(index);
+    if (qint64(r.valueOffset) + qint64(r.valueLength) > m_size) {
+        return QByteArrayView();
+    }
+    return QByteArrayView(m_data + r.valueOffset, r.valueLength);
+}
+
+qsizetype UniSettingsDb::indexOf(QStringView key) const
+{
+    if (m_entryCount <= 0) {
+        return -1;
+    }
+    const quint32 hash = keyHash(key);
+    const quint32 *table = reinterpret_cast<const quint32 *>(m_data + sizeof(Header));
+    quint32 bucket = hash & m_bucketMask;
+    // Bounded so a damaged table can't make us spin
+    for (quint32 probes = 0; probes <= m_bucketMask; ++probes) {
+        const quint32 index = table[bucket];
+        if (index == s_emptyBucket || index >= quint32(m_entryCount)) {
+            return -1;
+        }
+        if (record(index)->hash == hash && this->key(index) == key) {
+            return index;
+        }
+        bucket = (bucket + 1) & m_bucketMask;
+    }
+    return -1;
+}
+
+QString UniSettingsDb::pathFor(const QString &configPath)
+{
+    return configPath + ".db";
+}
+
+QByteArray UniSettingsDb::build(const QMap<QString, QByteArray> &rawValues,
+                                const UniFileFingerprint &source)
+{
+    const quint32 entryCount = quint32(rawValues.size());
+    quint32 bucketCount = 8;
+    while (bucketCount < entryCount * 2) {
+        bucketCount <<= 1;
+    }
+
+    QList<Record> records;
+    records.reserve(entryCount);
+    QByteArray keys;
+    QByteArray values;
+    for (auto it = rawValues.constBegin(); it != rawValues.constEnd(); ++it) {
+        Record r;
+        r.hash = keyHash(it.key());
+        r.keyOffset = quint32(keys.size());
+        r.keyLength = quint32(it.key().size());
+        r.valueOffset = quint32(values.size());
+        r.valueLength = quint32(it.value().size());
+        keys.append(reinterpret_cast<const char *>(it.key().utf16()), it.key().size() * 2);
+        values.append(it.value());
+        records.append(r);
+    }
+
+    const qint64 keysOffset = qint64(sizeof(Header)) + qint64(bucketCount) * 4
+            + qint64(entryCount) * qint64(sizeof(Record));
+    const qint64 valuesOffset = keysOffset + keys.size();
+    if (valuesOffset + values.size() > qint64(s_emptyBucket)) {
+        return QByteArray();
+    }
+
+    QList<quint32> table(bucketCount, s_emptyBucket);
+    for (quint32 index = 0; index < entryCount; ++index) {
+        Record &r = records[index];
+        r.keyOffset += quint32(keysOffset);
+        r.valueOffset += quint32(valuesOffset);
+        quint32 bucket = r.hash & (bucketCount - 1);
+        while (table.at(bucket) != s_emptyBucket) {
+            bucket = (bucket + 1) & (bucketCount - 1);
+        }
+        table[bucket] = index;
+    }
+
+    Header h;
+    std::memcpy(h.magic, s_magic, sizeof(s_magic));
+    h.version = s_version;
+    h.byteOrder = s_byteOrderMark;
+    h.bucketCount = bucketCount;
+    h.entryCount = entryCount;
+    h.sourceSize = source.size;
+    h.sourceMtimeNs = source.mtimeNs;
+    h.sourceInode = source.inode;
+    h.sourceContentHash = source.contentHash;
+
+    QByteArray image;
+    image.reserve(valuesOffset + values.size());
+    image.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    image.append(reinterpret_cast<const char *>(table.constData()), qsizetype(table.size()) * 4);
+    image.append(reinterpret_cast<const char *>(records.constData()),
+                 records.size() * qsizetype(sizeof(Record)));
+    image.append(keys);
+    image.append(values);
+    return image;
+}
+
+bool UniSettingsDb::writeFile(const QString &path, const QMap<QString, QByteArray> &rawValues,
+                              const UniFileFingerprint &source)
+{
+    const QByteArray image = build(rawValues, source);
+    if (image.isEmpty()) {
+        return false;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(image);
+    return file.commit();
+}
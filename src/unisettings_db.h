@@ -0,0 +1,62 @@
+#ifndef UNISETTINGS_DB_H
+#define UNISETTINGS_DB_H
+
+#include "unisettings_ini.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QMap>
+#include <QString>
+#include <QStringView>
+
+// Compiled, read-only copy of a config file: a hash table over the full
+// keys with the values kept escaped, exactly as the INI file holds them.
+// Opening maps the file and checks the header; lookups neither parse nor
+// allocate. The copy lives next to its source as "<name>.conf.db" and
+// records the source's fingerprint, so a stale one is simply ignored.
+class UniSettingsDb
+{
+public:
+    explicit UniSettingsDb(const QString &path);
+    // Use an image already in memory; it must outlive this object
+    explicit UniSettingsDb(QByteArrayView image);
+    ~UniSettingsDb();
+
+    bool isValid() const { return m_entryCount >= 0; }
+    // Whether this was compiled from the source file as it is now
+    bool isFreshFor(const UniFileFingerprint &source) const;
+    size_t sourceContentHash() const;
+
+    // Entries in key order
+    qsizetype size() const { return qMax<qsizetype>(m_entryCount, 0); }
+    QStringView key(qsizetype index) const;
+    QByteArrayView rawValue(qsizetype index) const;
+    // -1 if the key isn't there
+    qsizetype indexOf(QStringView key) const;
+
+    static QString pathFor(const QString &configPath);
+    static QByteArray build(const QMap<QString, QByteArray> &rawValues,
+                            const UniFileFingerprint &source = UniFileFingerprint());
+    // Atomically replace the compiled copy of a config file
+    static bool writeFile(const QString &path, const QMap<QString, QByteArray> &rawValues,
+                          const UniFileFingerprint &source);
+
+private:
+    Q_DISABLE_COPY(UniSettingsDb)
+
+    struct Header;
+    struct Record;
+
+    void validate();
+    const Header *header() const;
+    const Record *record(qsizetype index) const;
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    qsizetype m_entryCount = -1;
+    quint32 m_bucketMask = 0;
+};
+
+#endif // UNISETTINGS_DB_H
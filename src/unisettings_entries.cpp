@@ -0,0 +1,52 @@
+#include "unisettings_entries.h"
+
+#include <algorithm>
+
+UniSettingsEntries readEntries(const UniIniFile &file)
+{
+    UniSettingsEntries entries;
+    entries.reserve(file.entries().size());
+    for (const UniIniFile::Entry &entry : file.entries()) {
+        entries.append(UniSettingsEntry{file.key(entry), entry.value.toByteArray(), QVariant()});
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const UniSettingsEntry &a, const UniSettingsEntry &b) {
+        return a.key < b.key;
+    });
+
+    // Later duplicates win, as in QSettings
+    auto last = std::unique(entries.rbegin(), entries.rend(),
+                            [](const UniSettingsEntry &a, const UniSettingsEntry &b) {
+        return a.key == b.key;
+    });
+    entries.erase(entries.begin(), last.base());
+    return entries;
+}
+
+QHash<QString, QVariant> mergeEntries(UniSettingsEntries &cached, UniSettingsEntries &&current)
+{
+    QHash<QString, QVariant> changes;
+    auto oldIt = cached.begin();
+    auto newIt = current.begin();
+    while (oldIt != cached.end() || newIt != current.end()) {
+        if (newIt == current.end() || (oldIt != cached.end() && oldIt->key < newIt->key)) {
+            changes.insert(oldIt->key, QVariant());
+            ++oldIt;
+        } else if (oldIt == cached.end() || newIt->key < oldIt->key) {
+            newIt->value = UniIniFile::decodeValue(newIt->raw);
+            changes.insert(newIt->key, newIt->value);
+            ++newIt;
+        } else {
+            if (oldIt->raw == newIt->raw) {
+                newIt->value = std::move(oldIt->value);
+            } else {
+                newIt->value = UniIniFile::decodeValue(newIt->raw);
+                changes.insert(newIt->key, newIt->value);
+            }
+            ++oldIt;
+            ++newIt;
+        }
+    }
+    cached = std::move(current);
+    return changes;
+}
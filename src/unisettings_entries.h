@@ -0,0 +1,34 @@
+#ifndef UNISETTINGS_ENTRIES_H
+#define UNISETTINGS_ENTRIES_H
+
+#include "unisettings_ini.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVariant>
+
+// Cached contents of one config file, kept sorted by key so two versions
+// can be diffed in a single merge pass
+struct UniSettingsEntry
+{
+    QString key;
+    QByteArray raw;     // escaped value as it appears in the file
+    QVariant value;
+};
+using UniSettingsEntries = QList<UniSettingsEntry>;
+
+inline bool entryKeyLess(const UniSettingsEntry &entry, const QString &key)
+{
+    return entry.key < key;
+}
+
+// Keys and raw values of a parsed file, sorted; values are left undecoded
+UniSettingsEntries readEntries(const UniIniFile &file);
+
+// Replace cached with current, returning what changed. Only values whose
+// raw text differs get decoded; unchanged ones are carried over.
+QHash<QString, QVariant> mergeEntries(UniSettingsEntries &cached, UniSettingsEntries &&current);
+
+#endif // UNISETTINGS_ENTRIES_H
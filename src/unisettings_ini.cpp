@@ -0,0 +1,754 @@
+#include "unisettings_ini.h"
+#include <QDataStream>
+#include <QFileInfo>
+#include <QPoint>
+#include <QRect>
+#include <QSaveFile>
+#include <QSize>
+#include <QStringTokenizer>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#endif
+
+// The escaping rules below mirror QSettingsPrivate so files stay readable
+// by QSettings and files written by QSettings parse identically here.
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static inline bool isIniSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static inline bool isIniSpecial(char ch)
+{
+    return ch == '\n' || ch == '\r' || ch == '"' || ch == ';' || ch == '=' || ch == '\\';
+}
+
+static inline int digitValue(char ch, int base)
+{
+    int value = -1;
+    if (ch >= '0' && ch <= '9') {
+        value = ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+        value = ch - 'a' + 10;
+    } else if (ch >= 'A' && ch <= 'F') {
+        value = ch - 'A' + 10;
+    }
+    return value < base ? value : -1;
+}
+
+static QByteArrayView trimmed(QByteArrayView view)
+{
+    while (!view.isEmpty() && isIniSpace(view.front())) {
+        view = view.sliced(1);
+    }
+    while (!view.isEmpty() && isIniSpace(view.back())) {
+        view.chop(1);
+    }
+    return view;
+}
+
+// Find the next logical line: quoted newlines and backslash continuations
+// are part of the line, ';' outside quotes starts a comment
+static bool readLine(QByteArrayView data, qsizetype &pos, qsizetype &lineStart,
+                     qsizetype &lineLen, qsizetype &equalsPos)
+{
+    const qsizetype size = data.size();
+    bool inQuotes = false;
+    equalsPos = -1;
+
+    lineStart = pos;
+    while (lineStart < size && isIniSpace(data.at(lineStart))) {
+        ++lineStart;
+    }
+
+    qsizetype i = lineStart;
+    while (i < size) {
+        char ch = data.at(i);
+        if (!isIniSpecial(ch)) {
+            ++i;
+            continue;
+        }
+
+        ++i;
+        if (ch == '=') {
+            if (!inQuotes && equalsPos == -1) {
+                equalsPos = i - 1;
+            }
+        } else if (ch == '\n' || ch == '\r') {
+            if (i == lineStart + 1) {
+                ++lineStart;
+            } else if (!inQuotes) {
+                --i;
+                break;
+            }
+        } else if (ch == '\\') {
+            if (i < size) {
+                char escaped = data.at(i++);
+                if (i < size) {
+                    char next = data.at(i);
+                    if ((escaped == '\n' && next == '\r') || (escaped == '\r' && next == '\n')) {
+                        ++i;
+                    }
+                }
+            }
+        } else if (ch == '"') {
+            inQuotes = !inQuotes;
+        } else { // ';'
+            if (i == lineStart + 1) {
+                while (i < size && data.at(i) != '\n' && data.at(i) != '\r') {
+                    ++i;
+                }
+                while (i < size && isIniSpace(data.at(i))) {
+                    ++i;
+                }
+                lineStart = i;
+            } else if (!inQuotes) {
+                --i;
+                break;
+            }
+        }
+    }
+
+    pos = i;
+    lineLen = i - lineStart;
+    return lineLen > 0;
+}
+
+static void unescapeKey(QByteArrayView key, QString &result)
+{
+    const QString decoded = QString::fromUtf8(key);
+    const qsizetype size = decoded.size();
+    result.reserve(result.size() + size);
+
+    qsizetype i = 0;
+    while (i < size) {
+        char16_t ch = decoded.at(i).unicode();
+        if (ch == u'\\') {
+            result += u'/';
+            ++i;
+            continue;
+        }
+        if (ch != u'%' || i == size - 1) {
+            result += QChar(ch);
+            ++i;
+            continue;
+        }
+
+        int numDigits = 2;
+        qsizetype firstDigitPos = i + 1;
+        if (decoded.at(i + 1) == u'U') {
+            ++firstDigitPos;
+            numDigits = 4;
+        }
+        if (firstDigitPos + numDigits > size) {
+            result += u'%';
+            ++i;
+            continue;
+        }
+
+        bool ok;
+        ch = QStringView(decoded).sliced(firstDigitPos, numDigits).toUShort(&ok, 16);
+        if (!ok) {
+            result += u'%';
+            ++i;
+            continue;
+        }
+        result += QChar(ch);
+        i = firstDigitPos + numDigits;
+    }
+}
+
+static void escapeKey(QStringView key, QByteArray &result)
+{
+    result.reserve(result.size() + key.size() * 3 / 2);
+    for (QChar qch : key) {
+        uint ch = qch.unicode();
+        if (ch == '/') {
+            result += '\\';
+        } else if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')
+                   || ch == '_' || ch == '-' || ch == '.') {
+            result += char(ch);
+        } else if (ch <= 0xFF) {
+            result += '%';
+            result += hexDigits[ch / 16];
+            result += hexDigits[ch % 16];
+        } else {
+            result += "%U";
+            for (int shift = 12; shift >= 0; shift -= 4) {
+                result += hexDigits[(ch >> shift) % 16];
+            }
+        }
+    }
+}
+
+static void chopTrailingSpaces(QString &str, qsizetype limit)
+{
+    qsizetype n = str.size() - 1;
+    while (n >= limit && (str.at(n) == u' ' || str.at(n) == u'\t')) {
+        str.truncate(n--);
+    }
+}
+
+static qsizetype skipSpaces(QByteArrayView str, qsizetype i)
+{
+    while (i < str.size() && (str.at(i) == ' ' || str.at(i) == '\t')) {
+        ++i;
+    }
+    return i;
+}
+
+static char simpleEscape(char ch)
+{
+    switch (ch) {
+    case 'a': return '\a';
+    case 'b': return '\b';
+    case 'f': return '\f';
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    case 'v': return '\v';
+    case '"': return '"';
+    case '?': return '?';
+    case '\'': return '\'';
+    case '\\': return '\\';
+    default: return 0;
+    }
+}
+
+// Returns true and fills stringListResult when the value is a
+// comma-separated list, otherwise fills stringResult
+static bool unescapeStringList(QByteArrayView str, QString &stringResult, QStringList &stringListResult)
+{
+    const qsizetype size = str.size();
+    bool isStringList = false;
+    bool inQuotedString = false;
+    bool currentValueIsQuoted = false;
+    bool chopAtEnd = true;
+    qsizetype i = skipSpaces(str, 0);
+    qsizetype chopLimit = stringResult.size();
+
+    while (i < size) {
+        const char ch = str.at(i);
+        if (ch == '\\') {
+            ++i;
+            if (i >= size) {
+                chopAtEnd = false;
+                break;
+            }
+
+            const char escaped = str.at(i++);
+            if (char code = simpleEscape(escaped)) {
+                stringResult += QLatin1Char(code);
+            } else if (escaped == 'x' || digitValue(escaped, 8) != -1) {
+                const int base = escaped == 'x' ? 16 : 8;
+                const int shift = escaped == 'x' ? 4 : 3;
+                char16_t escapeVal = escaped == 'x' ? 0 : char16_t(escaped - '0');
+                if (escaped == 'x' && i >= size) {
+                    chopAtEnd = false;
+                    break;
+                }
+                if (escaped != 'x' || digitValue(str.at(i), 16) != -1) {
+                    int digit;
+                    while (i < size && (digit = digitValue(str.at(i), base)) != -1) {
+                        escapeVal = char16_t((escapeVal << shift) + digit);
+                        ++i;
+                    }
+                    stringResult += QChar(escapeVal);
+                }
+            } else if (escaped == '\n' || escaped == '\r') {
+                if (i < size) {
+                    const char next = str.at(i);
+                    if ((next == '\n' || next == '\r') && next != escaped) {
+                        ++i;
+                    }
+                }
+            }
+            // any other escaped character is dropped
+            chopLimit = stringResult.size();
+        } else if (ch == '"') {
+            ++i;
+            currentValueIsQuoted = true;
+            inQuotedString = !inQuotedString;
+            if (!inQuotedString) {
+                i = skipSpaces(str, i);
+                chopLimit = stringResult.size();
+            }
+        } else if (ch == ',' && !inQuotedString) {
+            if (!currentValueIsQuoted) {
+                chopTrailingSpaces(stringResult, chopLimit);
+            }
+            if (!isStringList) {
+                isStringList = true;
+                stringListResult.clear();
+            }
+            stringListResult.append(stringResult);
+            stringResult.clear();
+            currentValueIsQuoted = false;
+            i = skipSpaces(str, i + 1);
+            chopLimit = 0;
+        } else {
+            qsizetype j = i + 1;
+            while (j < size) {
+                const char next = str.at(j);
+                if (next == '\\' || next == '"' || next == ',') {
+                    break;
+                }
+                ++j;
+            }
+            stringResult += QString::fromUtf8(str.sliced(i, j - i));
+            i = j;
+        }
+    }
+
+    if (chopAtEnd && !currentValueIsQuoted) {
+        chopTrailingSpaces(stringResult, chopLimit);
+    }
+    if (isStringList) {
+        stringListResult.append(stringResult);
+    }
+    return isStringList;
+}
+
+static void escapeString(const QString &str, QByteArray &result)
+{
+    bool needsQuotes = false;
+    bool escapeNextIfDigit = false;
+    const bool useUtf8 = !(str.startsWith(QLatin1String("@ByteArray("))
+                           || str.startsWith(QLatin1String("@Variant("))
+                           || str.startsWith(QLatin1String("@DateTime(")));
+    const qsizetype startPos = result.size();
+
+    result.reserve(startPos + str.size() * 3 / 2);
+    for (qsizetype i = 0; i < str.size(); ++i) {
+        const QChar qch = str.at(i);
+        const uint ch = qch.unicode();
+        if (ch == ';' || ch == ',' || ch == '=') {
+            needsQuotes = true;
+        }
+
+        if (escapeNextIfDigit && digitValue(ch < 0x80 ? char(ch) : 0, 16) != -1) {
+            result += "\\x" + QByteArray::number(ch, 16);
+            continue;
+        }
+        escapeNextIfDigit = false;
+
+        switch (ch) {
+        case '\0':
+            result += "\\0";
+            escapeNextIfDigit = true;
+            break;
+        case '\a': result += "\\a"; break;
+        case '\b': result += "\\b"; break;
+        case '\f': result += "\\f"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        case '\v': result += "\\v"; break;
+        case '"':
+        case '\\':
+            result += '\\';
+            result += char(ch);
+            break;
+        default:
+            if (ch <= 0x1F || (ch >= 0x7F && !useUtf8)) {
+                result += "\\x" + QByteArray::number(ch, 16);
+                escapeNextIfDigit = true;
+            } else if (ch >= 0x7F) {
+                const qsizetype len = qch.isHighSurrogate() && i + 1 < str.size()
+                        && str.at(i + 1).isLowSurrogate() ? 2 : 1;
+                result += QStringView(str).sliced(i, len).toUtf8();
+                i += len - 1;
+            } else {
+                result += char(ch);
+            }
+        }
+    }
+
+    if (needsQuotes
+        || (startPos < result.size()
+            && (result.at(startPos) == ' ' || result.at(result.size() - 1) == ' '))) {
+        result.insert(startPos, '"');
+        result += '"';
+    }
+}
+
+static QStringList splitArgs(const QString &s, qsizetype offset)
+{
+    return QStringView(s).sliced(offset).chopped(1).toString().split(u' ', Qt::SkipEmptyParts);
+}
+
+static QVariant stringToVariant(const QString &s)
+{
+    if (s.startsWith(u'@')) {
+        if (s.endsWith(u')')) {
+            if (s.startsWith(QLatin1String("@ByteArray("))) {
+                return QVariant(QStringView(s).sliced(11).chopped(1).toLatin1());
+            } else if (s.startsWith(QLatin1String("@String("))) {
+                return QVariant(QStringView(s).sliced(8).chopped(1).toString());
+            } else if (s.startsWith(QLatin1String("@Variant("))
+                       || s.startsWith(QLatin1String("@DateTime("))) {
+                const bool isDateTime = s.at(1) == u'D';
+                QByteArray a = QStringView(s).sliced(isDateTime ? 10 : 9).toLatin1();
+                QDataStream stream(&a, QIODevice::ReadOnly);
+                stream.setVersion(isDateTime ? QDataStream::Qt_5_6 : QDataStream::Qt_4_0);
+                QVariant result;
+                stream >> result;
+                return result;
+            } else if (s.startsWith(QLatin1String("@Rect("))) {
+                const QStringList args = splitArgs(s, 6);
+                if (args.size() == 4) {
+                    return QVariant(QRect(args[0].toInt(), args[1].toInt(), args[2].toInt(), args[3].toInt()));
+                }
+            } else if (s.startsWith(QLatin1String("@Size("))) {
+                const QStringList args = splitArgs(s, 6);
+                if (args.size() == 2) {
+                    return QVariant(QSize(args[0].toInt(), args[1].toInt()));
+                }
+            } else if (s.startsWith(QLatin1String("@Point("))) {
+                const QStringList args = splitArgs(s, 7);
+                if (args.size() == 2) {
+                    return QVariant(QPoint(args[0].toInt(), args[1].toInt()));
+                }
+            } else if (s == QLatin1String("@Invalid()")) {
+                return QVariant();
+            }
+        }
+        if (s.startsWith(QLatin1String("@@"))) {
+            return QVariant(s.sliced(1));
+        }
+    }
+    return QVariant(s);
+}
+
+static QVariant stringListToVariant(const QStringList &l)
+{
+    QStringList outStringList = l;
+    for (qsizetype i = 0; i < outStringList.size(); ++i) {
+        const QString &str = outStringList.at(i);
+        if (str.startsWith(u'@')) {
+            if (str.size() < 2 || str.at(1) != u'@') {
+                QVariantList variantList;
+                variantList.reserve(l.size());
+                for (const QString &s : l) {
+                    variantList.append(stringToVariant(s));
+                }
+                return variantList;
+            }
+            outStringList[i].remove(0, 1);
+        }
+    }
+    return outStringList;
+}
+
+static QString variantToString(const QVariant &v)
+{
+    QString result;
+    switch (v.metaType().id()) {
+    case QMetaType::UnknownType:
+        result = QStringLiteral("@Invalid()");
+        break;
+    case QMetaType::QByteArray:
+        result = QLatin1String("@ByteArray(") + QString::fromLatin1(v.toByteArray()) + u')';
+        break;
+    case QMetaType::QString:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::Bool:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        result = v.toString();
+        if (result.contains(QChar::Null)) {
+            result = QLatin1String("@String(") + result + u')';
+        } else if (result.startsWith(u'@')) {
+            result.prepend(u'@');
+        }
+        break;
+    case QMetaType::QRect: {
+        const QRect r = v.toRect();
+        result = QString::asprintf("@Rect(%d %d %d %d)", r.x(), r.y(), r.width(), r.height());
+        break;
+    }
+    case QMetaType::QSize: {
+        const QSize s = v.toSize();
+        result = QString::asprintf("@Size(%d %d)", s.width(), s.height());
+        break;
+    }
+    case QMetaType::QPoint: {
+        const QPoint p = v.toPoint();
+        result = QString::asprintf("@Point(%d %d)", p.x(), p.y());
+        break;
+    }
+    default: {
+        const bool isDateTime = v.metaType().id() == QMetaType::QDateTime;
+        QByteArray a;
+        {
+            QDataStream stream(&a, QIODevice::WriteOnly);
+            stream.setVersion(isDateTime ? QDataStream::Qt_5_6 : QDataStream::Qt_4_0);
+            stream << v;
+        }
+        result = QLatin1String(isDateTime ? "@DateTime(" : "@Variant(")
+                + QString::fromLatin1(a) + u')';
+        break;
+    }
+    }
+    return result;
+}
+
+#ifdef Q_OS_LINUX
+static UniFileFingerprint fingerprintFromStat(const struct stat &st)
+{
+    UniFileFingerprint fingerprint;
+    fingerprint.exists = true;
+    fingerprint.size = st.st_size;
+    fingerprint.mtimeNs = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    fingerprint.inode = st.st_ino;
+    return fingerprint;
+}
+#endif
+
+UniFileFingerprint UniFileFingerprint::fromPath(const QString &path)
+{
+    UniFileFingerprint fingerprint;
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) == 0) {
+        fingerprint = fingerprintFromStat(st);
+    }
+#else
+    QFileInfo info(path);
+    if (info.exists()) {
+        fingerprint.exists = true;
+        fingerprint.size = info.size();
+        fingerprint.mtimeNs = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    }
+#endif
+    return fingerprint;
+}
+
+UniIniFile::UniIniFile(const QString &path)
+    : m_file(path)
+{
+    m_sectionPrefixes.append(QString());
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const qint64 size = m_file.size();
+    if (size <= 0) {
+        return;
+    }
+
+    if (uchar *data = m_file.map(0, size)) {
+        m_data = QByteArrayView(data, size);
+    } else {
+        m_buffer = m_file.readAll();
+        m_data = m_buffer;
+    }
+    parse(m_data);
+}
+
+UniIniFile::~UniIniFile()
+{
+}
+
+bool UniIniFile::exists() const
+{
+    return m_file.isOpen();
+}
+
+size_t UniIniFile::contentHash() const
+{
+    return qHash(m_data);
+}
+
+void UniIniFile::parse(QByteArrayView data)
+{
+    if (data.startsWith("\xef\xbb\xbf")) {
+        data = data.sliced(3);
+    }
+
+    qsizetype section = 0;
+    qsizetype pos = 0;
+    qsizetype lineStart;
+    qsizetype lineLen;
+    qsizetype equalsPos;
+    while (readLine(data, pos, lineStart, lineLen, equalsPos)) {
+        QByteArrayView line = data.sliced(lineStart, lineLen);
+        if (line.startsWith('[')) {
+            const qsizetype end = line.indexOf(']');
+            QByteArrayView name = trimmed(end == -1 ? line.sliced(1) : line.sliced(1, end - 1));
+
+            QString prefix;
+            if (qstrnicmp(name.data(), name.size(), "general", 7) == 0) {
+                // root section
+            } else {
+                if (qstrnicmp(name.data(), name.size(), "%general", 8) == 0) {
+                    prefix = QString::fromLatin1(name.sliced(1));
+                } else {
+                    unescapeKey(name, prefix);
+                }
+                prefix += u'/';
+            }
+            m_sectionPrefixes.append(prefix);
+            section = m_sectionPrefixes.size() - 1;
+            continue;
+        }
+
+        if (equalsPos == -1) {
+            continue;
+        }
+        equalsPos -= lineStart;
+        m_entries.append(Entry{section, trimmed(line.first(equalsPos)), line.sliced(equalsPos + 1)});
+    }
+}
+
+QString UniIniFile::key(const Entry &entry) const
+{
+    QString result = m_sectionPrefixes.at(entry.section);
+    unescapeKey(entry.key, result);
+    return result;
+}
+
+qsizetype UniIniFile::indexOf(const QString &key) const
+{
+    for (qsizetype i = m_entries.size() - 1; i >= 0; --i) {
+        if (this->key(m_entries.at(i)) == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+QVariant UniIniFile::value(const QString &key, const QVariant &defaultValue) const
+{
+    const qsizetype index = indexOf(key);
+    return index == -1 ? defaultValue : value(m_entries.at(index));
+}
+
+bool UniIniFile::contains(const QString &key) const
+{
+    return indexOf(key) != -1;
+}
+
+QString UniIniFile::normalizedKey(const QString &key)
+{
+    // Almost every key is already normal; hand it back without a copy
+    if (!key.startsWith(u'/') && !key.endsWith(u'/') && !key.contains(QLatin1String("//"))) {
+        return key;
+    }
+
+    QString result;
+    result.reserve(key.size());
+    for (const QStringView segment : QStringTokenizer(key, u'/', Qt::SkipEmptyParts)) {
+        if (!result.isEmpty()) {
+            result += u'/';
+        }
+        result += segment;
+    }
+    return result;
+}
+
+QVariant UniIniFile::decodeValue(QByteArrayView raw)
+{
+    QString stringResult;
+    QStringList stringListResult;
+    stringResult.reserve(raw.size());
+    if (unescapeStringList(raw, stringResult, stringListResult)) {
+        return stringListToVariant(stringListResult);
+    }
+    return stringToVariant(stringResult);
+}
+
+QByteArray UniIniFile::encodeValue(const QVariant &value)
+{
+    QByteArray result;
+    const int type = value.metaType().id();
+    if (type == QMetaType::QStringList
+        || (type == QMetaType::QVariantList && value.toList().size() != 1)) {
+        const QVariantList list = value.toList();
+        if (list.isEmpty()) {
+            // QVariant().toStringList() is empty too, so this round-trips
+            result = "@Invalid()";
+        }
+        for (qsizetype i = 0; i < list.size(); ++i) {
+            if (i != 0) {
+                result += ", ";
+            }
+            escapeString(variantToString(list.at(i)), result);
+        }
+    } else {
+        escapeString(variantToString(value), result);
+    }
+    return result;
+}
+
+QByteArray UniIniFile::serialize(const QMap<QString, QByteArray> &rawValues)
+{
+    QByteArray general;
+    QMap<QString, QByteArray> sections;
+    for (auto it = rawValues.constBegin(); it != rawValues.constEnd(); ++it) {
+        const QString &key = it.key();
+        const qsizetype slash = key.indexOf(u'/');
+        QByteArray &block = slash == -1 ? general : sections[key.left(slash)];
+        escapeKey(slash == -1 ? QStringView(key) : QStringView(key).sliced(slash + 1), block);
+        block += '=';
+        block += it.value();
+        block += '\n';
+    }
+
+    QByteArray result;
+    if (!general.isEmpty()) {
+        result += "[General]\n";
+        result += general;
+    }
+    for (auto it = sections.constBegin(); it != sections.constEnd(); ++it) {
+        QByteArray name;
+        escapeKey(it.key(), name);
+        // QSettings' spelling; it reads back as "General" either way
+        if (qstrnicmp(name.constData(), name.size(), "general", 7) == 0) {
+            name = "%General";
+        }
+        if (!result.isEmpty()) {
+            result += '\n';
+        }
+        result += '[' + name + "]\n";
+        result += it.value();
+    }
+    return result;
+}
+
+bool UniIniFile::writeFile(const QString &path, const QByteArray &contents, UniFileFingerprint *written)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(contents);
+
+#ifdef Q_OS_LINUX
+    // Stat the file we wrote rather than the path after the rename, so a
+    // concurrent replacement by another process can't be mistaken for ours
+    struct stat st;
+    if (written && file.flush() && ::fstat(file.handle(), &st) == 0) {
+        *written = fingerprintFromStat(st);
+        written->contentHash = qHash(QByteArrayView(contents));
+    } else if (written) {
+        *written = UniFileFingerprint();
+    }
+    return file.commit();
+#else
+    if (!file.commit()) {
+        return false;
+    }
+    if (written) {
+        *written = UniFileFingerprint::fromPath(path);
+        written->contentHash = qHash(QByteArrayView(contents));
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef UNISETTINGS_INI_H
+#define UNISETTINGS_INI_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+// Cheap identity of a config file on disk, used to skip re-diffing files
+// that a watcher event reported but that didn't actually change
+struct UniFileFingerprint
+{
+    bool exists = false;
+    qint64 size = 0;
+    qint64 mtimeNs = 0;
+    quint64 inode = 0;
+    size_t contentHash = 0;
+
+    // Stat-only fingerprint; contentHash is left for the caller to fill
+    static UniFileFingerprint fromPath(const QString &path);
+
+    bool sameStat(const UniFileFingerprint &other) const
+    {
+        return exists == other.exists && size == other.size
+            && mtimeNs == other.mtimeNs && inode == other.inode;
+    }
+};
+
+// Single-pass reader for the INI dialect QSettings writes. The file is
+// mapped and keys and values stay raw views into it until asked for.
+class UniIniFile
+{
+public:
+    struct Entry
+    {
+        qsizetype section;      // index into the section table
+        QByteArrayView key;     // escaped, relative to the section
+        QByteArrayView value;   // escaped, as written after '='
+    };
+
+    explicit UniIniFile(const QString &path);
+    ~UniIniFile();
+
+    bool exists() const;
+    size_t contentHash() const;
+    const QList<Entry> &entries() const { return m_entries; }
+
+    QString key(const Entry &entry) const;
+    QVariant value(const Entry &entry) const { return decodeValue(entry.value); }
+    // Later duplicates win, as in QSettings
+    QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    bool contains(const QString &key) const;
+
+    // Key as QSettings stores it: runs of '/' collapsed, none at either end
+    static QString normalizedKey(const QString &key);
+
+    static QVariant decodeValue(QByteArrayView raw);
+    static QByteArray encodeValue(const QVariant &value);
+
+    // Lay escaped values out in sections the way QSettings does
+    static QByteArray serialize(const QMap<QString, QByteArray> &rawValues);
+    // Atomically replace the file with the given contents, optionally
+    // reporting the fingerprint of exactly what was written
+    static bool writeFile(const QString &path, const QByteArray &contents,
+                          UniFileFingerprint *written = nullptr);
+
+private:
+    Q_DISABLE_COPY(UniIniFile)
+
+    void parse(QByteArrayView data);
+    qsizetype indexOf(const QString &key) const;
+
+    QFile m_file;
+    QByteArray m_buffer;            // fallback when the file can't be mapped
+    QByteArrayView m_data;
+    QStringList m_sectionPrefixes;  // "" for [General], "name/" otherwise
+    QList<Entry> m_entries;
+};
+
+#endif // UNISETTINGS_INI_H
@@ -2,6 +2,29 @@
 #define UNISETTINGS_MACROS_H
 
 #include "unisettings.h"
+#include <QStringView>
+
+// FNV-1a over UTF-16 code units. The literal overload is constexpr so the
+// keys in UNISETTINGS_HANDLE_CHANGE become case labels of one switch.
+constexpr quint64 uniSettingsKeyHash(const char16_t *key)
+{
+    quint64 hash = 14695981039346656037ull;
+    for (; *key; ++key) {
+        hash ^= quint64(*key);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline quint64 uniSettingsKeyHash(QStringView key)
+{
+    quint64 hash = 14695981039346656037ull;
+    for (QChar c : key) {
+        hash ^= quint64(c.unicode());
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
 // Base class for creating Uni settings objects
 class UniSettingsObject : public QObject {
@@ -37,46 +60,37 @@ private: \
     void loadAllSettings(); \
     void onSettingChanged(const QString &key, const QVariant &value) override;
 
-// macro for defining settings with types
+// macro for defining settings with types. The value is kept in a typed
+// member, read once at construction and then only updated by the setter
+// and by UNISETTINGS_HANDLE_CHANGE, all on the object's thread.
 #define UNISETTINGS_PROPERTY(Type, name, key, defaultValue) \
-private: \
-    Q_PROPERTY(Type name READ name WRITE set##name NOTIFY name##Changed) \
-public: \
-    Type name() const { \
-        return m_settings->value(key, defaultValue).value<Type>(); \
-    } \
-    void set##name(const Type &value) { \
-        if (name() != value) { \
-            m_settings->setValue(key, value); \
-            emit name##Changed(); \
-        } \
-    } \
-Q_SIGNALS: \
-    void name##Changed();
+    UNISETTINGS_PROPERTY_IMPL(Type, name, QStringLiteral(key), defaultValue)
 
 // simplified ver with auto keys
 #define UNISETTINGS_PROPERTY_AUTO(Type, name, defaultValue) \
     UNISETTINGS_PROPERTY(Type, name, #name, defaultValue)
 
-// grouping macro
+// grouping macro; group and key are joined at compile time, so the
+// property never touches the UniSettings group cursor
 #define UNISETTINGS_PROPERTY_GROUP(Type, name, group, key, defaultValue) \
+    UNISETTINGS_PROPERTY(Type, name, group "/" key, defaultValue)
+
+#define UNISETTINGS_PROPERTY_IMPL(Type, name, fullKey, defaultValue) \
 private: \
     Q_PROPERTY(Type name READ name WRITE set##name NOTIFY name##Changed) \
+    Type m_##name = m_settings->value(name##Key(), name##Default()).value<Type>(); \
 public: \
+    /* for reading from other threads: settings()->snapshot().value(nameKey(), nameDefault()) */ \
+    static QString name##Key() { return fullKey; } \
+    static Type name##Default() { return defaultValue; } \
     Type name() const { \
-        m_settings->beginGroup(group); \
-        auto val = m_settings->value(key, defaultValue).value<Type>(); \
-        m_settings->endGroup(); \
-        return val; \
+        return m_##name; \
     } \
     void set##name(const Type &value) { \
-        m_settings->beginGroup(group); \
-        if (m_settings->value(key, defaultValue).value<Type>() != value) { \
-            m_settings->setValue(key, value); \
-            m_settings->endGroup(); \
+        if (m_##name != value) { \
+            m_##name = value; \
+            m_settings->setValue(name##Key(), value); \
             emit name##Changed(); \
-        } else { \
-            m_settings->endGroup(); \
         } \
     } \
 Q_SIGNALS: \
@@ -86,26 +100,42 @@ Q_SIGNALS: \
 #define UNISETTINGS_END() \
 };
 
-// implementation macros
+// implementation macros. Members already hold their values by the time
+// loadAllSettings() runs; it only writes the defaults that are missing,
+// as one batch: a single file write and a single valuesChanged().
 #define UNISETTINGS_IMPL_BEGIN(ClassName) \
-void ClassName::loadAllSettings() {
+void ClassName::loadAllSettings() { \
+    m_settings->beginBatch();
 
 #define UNISETTINGS_LOAD_PROPERTY(name) \
-    if (!m_settings->contains(#name)) { \
-        m_settings->setValue(#name, name()); \
-    } \
-    emit name##Changed();
+    if (!m_settings->contains(name##Key())) { \
+        m_settings->setValue(name##Key(), m_##name); \
+    }
 
 #define UNISETTINGS_IMPL_CHANGE_BEGIN(ClassName) \
-    m_settings->sync(); \
+    m_settings->commitBatch(); \
 } \
 void ClassName::onSettingChanged(const QString &key, const QVariant &value) { \
-    Q_UNUSED(value);
+    switch (uniSettingsKeyHash(QStringView(key))) {
 
-#define UNISETTINGS_HANDLE_CHANGE(key, name) \
-    if (key == key) emit name##Changed();
+// settingKey is the full key, group included ("window/maximized"); a key
+// handled twice, or two keys with the same hash, fail to compile
+#define UNISETTINGS_HANDLE_CHANGE(settingKey, name) \
+    case uniSettingsKeyHash(u"" settingKey): \
+        if (key == QStringView(u"" settingKey)) { \
+            /* a removed key reads as its default again */ \
+            auto newValue = value.isValid() ? value.value<decltype(m_##name)>() : name##Default(); \
+            if (newValue != m_##name) { \
+                m_##name = std::move(newValue); \
+                emit name##Changed(); \
+            } \
+        } \
+        break;
 
 #define UNISETTINGS_IMPL_END() \
+    default: \
+        break; \
+    } \
 }
 
 #endif // UNISETTINGS_MACROS_H
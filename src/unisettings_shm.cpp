@@ -0,0 +1,283 @@
+#include "unisettings_shm.h"
+#include "unisettings_db.h"
+
+#include <QDebug>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const quint32 s_magic = 0x554e5348; // "UNSH"
+const quint32 s_version = 1;
+const qint64 s_minimumSize = 64 * 1024;
+// Readers give up and fall back to the files after this many torn reads
+const int s_maxReadAttempts = 16;
+
+QByteArray segmentName()
+{
+    const QByteArray name = qgetenv("UNISETTINGS_SHM_NAME");
+    if (!name.isEmpty()) {
+        return name;
+    }
+    return "/unisettings-" + QByteArray::number(uint(::getuid()));
+}
+
+} // namespace
+
+struct UniSettingsShmHeader
+{
+    quint32 magic;
+    quint32 version;
+    std::atomic<quint64> generation;    // odd while the image is rewritten
+    std::atomic<qint64> publisherPid;   // 0 once the publisher has left
+    std::atomic<qint64> capacity;       // bytes available for the image
+    std::atomic<qint64> imageSize;
+    char reserved[24];                  // keeps the image 64-byte aligned
+
+    uchar *image() { return reinterpret_cast<uchar *>(this + 1); }
+    const uchar *image() const { return reinterpret_cast<const uchar *>(this + 1); }
+
+    bool hasLivePublisher() const
+    {
+        const qint64 pid = publisherPid.load(std::memory_order_relaxed);
+        return pid > 0 && (::kill(pid_t(pid), 0) == 0 || errno == EPERM);
+    }
+};
+
+static_assert(sizeof(UniSettingsShmHeader) == 64, "Header must stay 64 bytes");
+static_assert(std::atomic<quint64>::is_always_lock_free
+              && std::atomic<qint64>::is_always_lock_free,
+              "Shared counters must be lock-free");
+
+UniSettingsShmPublisher::UniSettingsShmPublisher() = default;
+
+UniSettingsShmPublisher::~UniSettingsShmPublisher()
+{
+    if (m_header) {
+        // Leave the segment for the next publisher; readers see we're gone
+        m_header->publisherPid.store(0, std::memory_order_relaxed);
+        ::munmap(m_header, m_mappedSize);
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool UniSettingsShmPublisher::acquire()
+{
+    if (m_fd < 0) {
+        m_fd = ::shm_open(segmentName().constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (m_fd < 0) {
+            qWarning() << "Failed to open shared settings segment:" << strerror(errno);
+            return false;
+        }
+    }
+    // Held until we exit, crash included
+    if (::flock(m_fd, LOCK_EX | LOCK_NB) != 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0) {
+        return false;
+    }
+    const bool fresh = st.st_size < qint64(sizeof(UniSettingsShmHeader));
+    if (fresh && ::ftruncate(m_fd, s_minimumSize) != 0) {
+        return false;
+    }
+    const qint64 size = fresh ? s_minimumSize : qint64(st.st_size);
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_mappedSize = size;
+
+    auto *header = static_cast<UniSettingsShmHeader *>(data);
+    if (fresh || header->magic != s_magic || header->version != s_version) {
+        header = new (data) UniSettingsShmHeader{s_magic, s_version, {0}, {0}, {0}, {0}, {}};
+    }
+    // A previous publisher may have died halfway through a rewrite
+    const quint64 generation = header->generation.load(std::memory_order_relaxed);
+    header->generation.store(generation + (generation & 1), std::memory_order_relaxed);
+    header->capacity.store(m_mappedSize - qint64(sizeof(UniSettingsShmHeader)),
+                           std::memory_order_relaxed);
+    header->publisherPid.store(::getpid(), std::memory_order_release);
+    m_header = header;
+    return true;
+}
+
+bool UniSettingsShmPublisher::reserve(qint64 imageSize)
+{
+    const qint64 needed = qint64(sizeof(UniSettingsShmHeader)) + imageSize;
+    if (needed <= m_mappedSize) {
+        return true;
+    }
+    qint64 size = m_mappedSize;
+    while (size < needed) {
+        size *= 2;
+    }
+    if (::ftruncate(m_fd, size) != 0) {
+        return false;
+    }
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    ::munmap(m_header, m_mappedSize);
+    m_header = static_cast<UniSettingsShmHeader *>(data);
+    m_mappedSize = size;
+    return true;
+}
+
+bool UniSettingsShmPublisher::publish(const QMap<QString, QByteArray> &rawValues)
+{
+    if (!m_header && !acquire()) {
+        return false;
+    }
+    const QByteArray image = UniSettingsDb::build(rawValues);
+    if (image.isEmpty() || !reserve(image.size())) {
+        return false;
+    }
+
+    const quint64 generation = m_header->generation.load(std::memory_order_relaxed);
+    m_header->generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->capacity.store(m_mappedSize - qint64(sizeof(UniSettingsShmHeader)),
+                             std::memory_order_relaxed);
+    std::memcpy(m_header->image(), image.constData(), image.size());
+    m_header->imageSize.store(image.size(), std::memory_order_relaxed);
+    m_header->generation.store(generation + 2, std::memory_order_release);
+    return true;
+}
+
+UniSettingsShmReader::UniSettingsShmReader() = default;
+
+UniSettingsShmReader::~UniSettingsShmReader()
+{
+    detach();
+}
+
+bool UniSettingsShmReader::attach()
+{
+    m_fd = ::shm_open(segmentName().constData(), O_RDONLY | O_CLOEXEC, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (!remap() || m_header->magic != s_magic || m_header->version != s_version) {
+        detach();
+        return false;
+    }
+    return true;
+}
+
+void UniSettingsShmReader::detach()
+{
+    if (m_header) {
+        ::munmap(const_cast<UniSettingsShmHeader *>(m_header), m_mappedSize);
+        m_header = nullptr;
+        m_mappedSize = 0;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Map the whole segment, which only ever grows
+bool UniSettingsShmReader::remap()
+{
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0 || st.st_size < qint64(sizeof(UniSettingsShmHeader))) {
+        return false;
+    }
+    void *data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    if (m_header) {
+        ::munmap(const_cast<UniSettingsShmHeader *>(m_header), m_mappedSize);
+    }
+    m_header = static_cast<const UniSettingsShmHeader *>(data);
+    m_mappedSize = st.st_size;
+    return true;
+}
+
+bool UniSettingsShmReader::attached()
+{
+    if (m_recheck.hasExpired()) {
+        m_recheck.setRemainingTime(1000);
+        if (!m_header && !attach()) {
+            return false;
+        }
+        if (!m_header->hasLivePublisher()) {
+            detach();
+            return false;
+        }
+    }
+    return m_header != nullptr;
+}
+
+quint64 UniSettingsShmReader::generation()
+{
+    if (!attached()) {
+        return 0;
+    }
+    // While odd, the previous image is still the latest complete one
+    return m_header->generation.load(std::memory_order_acquire) & ~quint64(1);
+}
+
+bool UniSettingsShmReader::lookup(const QString &appName, const QString &key,
+                                  bool *found, QByteArray *raw)
+{
+    if (!attached()) {
+        return false;
+    }
+
+    const QString fullKey = appName + "/" + key;
+    for (int attempt = 0; attempt < s_maxReadAttempts; ++attempt) {
+        const quint64 generation = m_header->generation.load(std::memory_order_acquire);
+        if (generation == 0) {
+            return false; // nothing published yet
+        }
+        if (generation & 1) {
+            continue;
+        }
+        const qint64 capacity = m_header->capacity.load(std::memory_order_relaxed);
+        if (qint64(sizeof(UniSettingsShmHeader)) + capacity > m_mappedSize) {
+            if (!remap()) {
+                return false;
+            }
+            continue;
+        }
+        const qint64 size = m_header->imageSize.load(std::memory_order_relaxed);
+        if (size > capacity) {
+            continue;
+        }
+
+        // May be torn; every range is bounds-checked and the result is only
+        // used if the generation didn't move meanwhile
+        UniSettingsDb db(QByteArrayView(m_header->image(), size));
+        const qsizetype index = db.indexOf(fullKey);
+        QByteArray value = index >= 0 ? db.rawValue(index).toByteArray() : QByteArray();
+        const bool valid = db.isValid();
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->generation.load(std::memory_order_relaxed) == generation) {
+            if (!valid) {
+                return false;
+            }
+            *found = index >= 0;
+            *raw = value;
+            return true;
+        }
+    }
+    return false;
+}
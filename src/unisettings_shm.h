@@ -0,0 +1,67 @@
+#ifndef UNISETTINGS_SHM_H
+#define UNISETTINGS_SHM_H
+
+#include <QByteArray>
+#include <QDeadlineTimer>
+#include <QMap>
+#include <QString>
+
+// Settings of every app, published by the system-scope instance into one
+// POSIX shared memory segment per user. The segment holds a compiled
+// UniSettingsDb image keyed "<appname>/<key>" behind a seqlock generation:
+// odd while the publisher rewrites it, bumped to the next even number once
+// the new image is complete. UNISETTINGS_SHM_NAME overrides the segment name,
+// e.g. to keep tests off the session's segment.
+struct UniSettingsShmHeader;
+
+class UniSettingsShmPublisher
+{
+public:
+    UniSettingsShmPublisher();
+    ~UniSettingsShmPublisher();
+
+    // Only one process per user publishes; the others' calls fail until
+    // that one goes away and the next publish() takes over
+    bool publish(const QMap<QString, QByteArray> &rawValues);
+
+private:
+    Q_DISABLE_COPY(UniSettingsShmPublisher)
+
+    bool acquire();
+    bool reserve(qint64 imageSize);
+
+    int m_fd = -1;
+    UniSettingsShmHeader *m_header = nullptr;
+    qint64 m_mappedSize = 0;
+};
+
+class UniSettingsShmReader
+{
+public:
+    UniSettingsShmReader();
+    ~UniSettingsShmReader();
+
+    // Last completed generation of a live publisher, 0 if there is none.
+    // Anything looked up under the same generation is still current.
+    quint64 generation();
+
+    // False if no live publisher is attached; otherwise whether the key is
+    // set, with its escaped value copied into raw
+    bool lookup(const QString &appName, const QString &key, bool *found, QByteArray *raw);
+
+private:
+    Q_DISABLE_COPY(UniSettingsShmReader)
+
+    bool attached();
+    bool attach();
+    void detach();
+    bool remap();
+
+    int m_fd = -1;
+    const UniSettingsShmHeader *m_header = nullptr;
+    qint64 m_mappedSize = 0;
+    // Bounds how often a missing or dead publisher is looked for again
+    QDeadlineTimer m_recheck;
+};
+
+#endif // UNISETTINGS_SHM_H
@@ -0,0 +1,144 @@
+#include "unisettings_watcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+
+#ifdef UNISETTINGS_HAVE_INOTIFY
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+class UniSettingsQtWatcher : public UniSettingsWatcher
+{
+public:
+    UniSettingsQtWatcher(const QString &configDir, QObject *parent)
+        : UniSettingsWatcher(parent)
+        , m_watcher(new QFileSystemWatcher(this))
+    {
+        if (QFileInfo(configDir).exists()) {
+            m_watcher->addPath(configDir);
+        }
+        connect(m_watcher, &QFileSystemWatcher::fileChanged,
+                this, &UniSettingsWatcher::fileChanged);
+        connect(m_watcher, &QFileSystemWatcher::directoryChanged,
+                this, &UniSettingsWatcher::directoryChanged);
+    }
+
+    void watchFile(const QString &path) override
+    {
+        // QFileSystemWatcher silently drops the watch when a file is
+        // replaced by rename, so check it's still there
+        if (m_watcher->files().contains(path) || !QFileInfo::exists(path)) {
+            return;
+        }
+        if (!m_watcher->addPath(path)) {
+            qWarning() << "Failed to watch config file:" << path;
+        }
+    }
+
+private:
+    QFileSystemWatcher *m_watcher;
+};
+
+#ifdef UNISETTINGS_HAVE_INOTIFY
+class UniSettingsInotifyWatcher : public UniSettingsWatcher
+{
+public:
+    static UniSettingsInotifyWatcher *create(const QString &configDir, QObject *parent)
+    {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        // Atomic saves show up as IN_MOVED_TO, in-place writes as
+        // IN_CLOSE_WRITE; the directory watch survives both
+        if (inotify_add_watch(fd, QFile::encodeName(configDir).constData(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        return new UniSettingsInotifyWatcher(fd, configDir, parent);
+    }
+
+    ~UniSettingsInotifyWatcher()
+    {
+        ::close(m_fd);
+    }
+
+    void watchFile(const QString &path) override
+    {
+        Q_UNUSED(path);
+    }
+
+private:
+    UniSettingsInotifyWatcher(int fd, const QString &configDir, QObject *parent)
+        : UniSettingsWatcher(parent)
+        , m_fd(fd)
+        , m_configDir(configDir)
+        , m_notifier(new QSocketNotifier(fd, QSocketNotifier::Read, this))
+    {
+        connect(m_notifier, &QSocketNotifier::activated, this, [this]() {
+            readEvents();
+        });
+    }
+
+    void readEvents()
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        for (;;) {
+            ssize_t len = ::read(m_fd, buffer, sizeof(buffer));
+            if (len <= 0) {
+                break;
+            }
+
+            for (char *ptr = buffer; ptr < buffer + len; ) {
+                const auto *event = reinterpret_cast<const struct inotify_event *>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    rescan();
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue;
+                }
+                QString name = QFile::decodeName(event->name);
+                if (name.endsWith(QLatin1String(".conf"))) {
+                    emit fileChanged(m_configDir + "/" + name);
+                }
+            }
+        }
+    }
+
+    // Events were lost: report every config and let fingerprints sort it out
+    void rescan()
+    {
+        QDir dir(m_configDir);
+        QStringList filters;
+        filters << "*.conf";
+        const QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
+        for (const QFileInfo &fileInfo : files) {
+            emit fileChanged(fileInfo.absoluteFilePath());
+        }
+        emit directoryChanged(m_configDir);
+    }
+
+    int m_fd;
+    QString m_configDir;
+    QSocketNotifier *m_notifier;
+};
+#endif
+
+UniSettingsWatcher *UniSettingsWatcher::create(const QString &configDir, QObject *parent)
+{
+#ifdef UNISETTINGS_HAVE_INOTIFY
+    if (UniSettingsWatcher *watcher = UniSettingsInotifyWatcher::create(configDir, parent)) {
+        return watcher;
+    }
+    qWarning() << "inotify unavailable, falling back to QFileSystemWatcher for" << configDir;
+#endif
+    return new UniSettingsQtWatcher(configDir, parent);
+}
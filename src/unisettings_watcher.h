@@ -0,0 +1,32 @@
+#ifndef UNISETTINGS_WATCHER_H
+#define UNISETTINGS_WATCHER_H
+
+#include <QObject>
+#include <QString>
+
+// Reports changes to the config files in the settings directory. The
+// inotify backend watches the directory once and reports every file by
+// name; the QFileSystemWatcher backend needs each file added explicitly.
+class UniSettingsWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static UniSettingsWatcher *create(const QString &configDir, QObject *parent = nullptr);
+
+    // Make sure changes to this file get reported, re-arming the watch if
+    // the file was replaced since
+    virtual void watchFile(const QString &path) = 0;
+
+signals:
+    void fileChanged(const QString &path);
+    void directoryChanged(const QString &path);
+
+protected:
+    explicit UniSettingsWatcher(QObject *parent)
+        : QObject(parent)
+    {
+    }
+};
+
+#endif // UNISETTINGS_WATCHER_H
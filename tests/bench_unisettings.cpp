@@ -0,0 +1,422 @@
+#include "unisettings.h"
+#include "unisettings_entries.h"
+#include "unisettings_ini.h"
+#include "unisettings_macros.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSet>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTest>
+
+// Benchmarks for the hot paths the library was tuned for. Run with
+// "bench_unisettings -tickcounter" or "-perf" for steadier numbers; each
+// function states what it is measured against.
+class BenchUniSettings : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanupTestCase();
+
+    void diffKeySets_data();
+    void diffKeySets();
+    void diffSortedMerge_data();
+    void diffSortedMerge();
+    void readHit();
+    void readSnapshot();
+    void startupQSettings();
+    void startupUniSettings();
+    void dispatch_data();
+    void dispatch();
+    void coldStart();
+    void systemScopeLoad_data();
+    void systemScopeLoad();
+
+private:
+    QString configPath(const QString &appName) const { return m_configDir + "/" + appName + ".conf"; }
+
+    QString m_configDir;
+};
+
+// A fresh app with 50 properties: one read pass and one batched write
+UNISETTINGS_CLASS(ColdStartSettings, "bench_coldstart")
+    UNISETTINGS_PROPERTY_AUTO(int, p00, 0)
+    UNISETTINGS_PROPERTY_AUTO(int, p01, 1)
+    UNISETTINGS_PROPERTY_AUTO(int, p02, 2)
+    UNISETTINGS_PROPERTY_AUTO(int, p03, 3)
+    UNISETTINGS_PROPERTY_AUTO(int, p04, 4)
+    UNISETTINGS_PROPERTY_AUTO(int, p05, 5)
+    UNISETTINGS_PROPERTY_AUTO(int, p06, 6)
+    UNISETTINGS_PROPERTY_AUTO(int, p07, 7)
+    UNISETTINGS_PROPERTY_AUTO(int, p08, 8)
+    UNISETTINGS_PROPERTY_AUTO(int, p09, 9)
+    UNISETTINGS_PROPERTY_AUTO(int, p10, 10)
+    UNISETTINGS_PROPERTY_AUTO(int, p11, 11)
+    UNISETTINGS_PROPERTY_AUTO(int, p12, 12)
+    UNISETTINGS_PROPERTY_AUTO(int, p13, 13)
+    UNISETTINGS_PROPERTY_AUTO(int, p14, 14)
+    UNISETTINGS_PROPERTY_AUTO(int, p15, 15)
+    UNISETTINGS_PROPERTY_AUTO(int, p16, 16)
+    UNISETTINGS_PROPERTY_AUTO(int, p17, 17)
+    UNISETTINGS_PROPERTY_AUTO(int, p18, 18)
+    UNISETTINGS_PROPERTY_AUTO(int, p19, 19)
+    UNISETTINGS_PROPERTY_AUTO(int, p20, 20)
+    UNISETTINGS_PROPERTY_AUTO(int, p21, 21)
+    UNISETTINGS_PROPERTY_AUTO(int, p22, 22)
+    UNISETTINGS_PROPERTY_AUTO(int, p23, 23)
+    UNISETTINGS_PROPERTY_AUTO(int, p24, 24)
+    UNISETTINGS_PROPERTY_AUTO(int, p25, 25)
+    UNISETTINGS_PROPERTY_AUTO(int, p26, 26)
+    UNISETTINGS_PROPERTY_AUTO(int, p27, 27)
+    UNISETTINGS_PROPERTY_AUTO(int, p28, 28)
+    UNISETTINGS_PROPERTY_AUTO(int, p29, 29)
+    UNISETTINGS_PROPERTY_AUTO(int, p30, 30)
+    UNISETTINGS_PROPERTY_AUTO(int, p31, 31)
+    UNISETTINGS_PROPERTY_AUTO(int, p32, 32)
+    UNISETTINGS_PROPERTY_AUTO(int, p33, 33)
+    UNISETTINGS_PROPERTY_AUTO(int, p34, 34)
+    UNISETTINGS_PROPERTY_AUTO(int, p35, 35)
+    UNISETTINGS_PROPERTY_AUTO(int, p36, 36)
+    UNISETTINGS_PROPERTY_AUTO(int, p37, 37)
+    UNISETTINGS_PROPERTY_AUTO(int, p38, 38)
+    UNISETTINGS_PROPERTY_AUTO(int, p39, 39)
+    UNISETTINGS_PROPERTY_AUTO(int, p40, 40)
+    UNISETTINGS_PROPERTY_AUTO(int, p41, 41)
+    UNISETTINGS_PROPERTY_AUTO(int, p42, 42)
+    UNISETTINGS_PROPERTY_AUTO(int, p43, 43)
+    UNISETTINGS_PROPERTY_AUTO(int, p44, 44)
+    UNISETTINGS_PROPERTY_AUTO(int, p45, 45)
+    UNISETTINGS_PROPERTY_AUTO(int, p46, 46)
+    UNISETTINGS_PROPERTY_AUTO(int, p47, 47)
+    UNISETTINGS_PROPERTY_AUTO(int, p48, 48)
+    UNISETTINGS_PROPERTY_AUTO(int, p49, 49)
+UNISETTINGS_END()
+
+UNISETTINGS_IMPL_BEGIN(ColdStartSettings)
+    UNISETTINGS_LOAD_PROPERTY(p00)
+    UNISETTINGS_LOAD_PROPERTY(p01)
+    UNISETTINGS_LOAD_PROPERTY(p02)
+    UNISETTINGS_LOAD_PROPERTY(p03)
+    UNISETTINGS_LOAD_PROPERTY(p04)
+    UNISETTINGS_LOAD_PROPERTY(p05)
+    UNISETTINGS_LOAD_PROPERTY(p06)
+    UNISETTINGS_LOAD_PROPERTY(p07)
+    UNISETTINGS_LOAD_PROPERTY(p08)
+    UNISETTINGS_LOAD_PROPERTY(p09)
+    UNISETTINGS_LOAD_PROPERTY(p10)
+    UNISETTINGS_LOAD_PROPERTY(p11)
+    UNISETTINGS_LOAD_PROPERTY(p12)
+    UNISETTINGS_LOAD_PROPERTY(p13)
+    UNISETTINGS_LOAD_PROPERTY(p14)
+    UNISETTINGS_LOAD_PROPERTY(p15)
+    UNISETTINGS_LOAD_PROPERTY(p16)
+    UNISETTINGS_LOAD_PROPERTY(p17)
+    UNISETTINGS_LOAD_PROPERTY(p18)
+    UNISETTINGS_LOAD_PROPERTY(p19)
+    UNISETTINGS_LOAD_PROPERTY(p20)
+    UNISETTINGS_LOAD_PROPERTY(p21)
+    UNISETTINGS_LOAD_PROPERTY(p22)
+    UNISETTINGS_LOAD_PROPERTY(p23)
+    UNISETTINGS_LOAD_PROPERTY(p24)
+    UNISETTINGS_LOAD_PROPERTY(p25)
+    UNISETTINGS_LOAD_PROPERTY(p26)
+    UNISETTINGS_LOAD_PROPERTY(p27)
+    UNISETTINGS_LOAD_PROPERTY(p28)
+    UNISETTINGS_LOAD_PROPERTY(p29)
+    UNISETTINGS_LOAD_PROPERTY(p30)
+    UNISETTINGS_LOAD_PROPERTY(p31)
+    UNISETTINGS_LOAD_PROPERTY(p32)
+    UNISETTINGS_LOAD_PROPERTY(p33)
+    UNISETTINGS_LOAD_PROPERTY(p34)
+    UNISETTINGS_LOAD_PROPERTY(p35)
+    UNISETTINGS_LOAD_PROPERTY(p36)
+    UNISETTINGS_LOAD_PROPERTY(p37)
+    UNISETTINGS_LOAD_PROPERTY(p38)
+    UNISETTINGS_LOAD_PROPERTY(p39)
+    UNISETTINGS_LOAD_PROPERTY(p40)
+    UNISETTINGS_LOAD_PROPERTY(p41)
+    UNISETTINGS_LOAD_PROPERTY(p42)
+    UNISETTINGS_LOAD_PROPERTY(p43)
+    UNISETTINGS_LOAD_PROPERTY(p44)
+    UNISETTINGS_LOAD_PROPERTY(p45)
+    UNISETTINGS_LOAD_PROPERTY(p46)
+    UNISETTINGS_LOAD_PROPERTY(p47)
+    UNISETTINGS_LOAD_PROPERTY(p48)
+    UNISETTINGS_LOAD_PROPERTY(p49)
+UNISETTINGS_IMPL_CHANGE_BEGIN(ColdStartSettings)
+UNISETTINGS_IMPL_END()
+
+static const int keyCount = 10000;
+
+static QString benchKey(int i)
+{
+    return QStringLiteral("group%1/key%2").arg(i / 100).arg(i % 100);
+}
+
+// keyCount keys, the first changed of them holding a different value
+static void writeConfig(const QString &path, int changed)
+{
+    QMap<QString, QByteArray> rawValues;
+    for (int i = 0; i < keyCount; ++i) {
+        const int n = i < changed ? i + keyCount : i;
+        const QVariant value = i % 2 ? QVariant(n) : QVariant(QStringLiteral("value %1").arg(n));
+        rawValues.insert(benchKey(i), UniIniFile::encodeValue(value));
+    }
+    QVERIFY(UniIniFile::writeFile(path, UniIniFile::serialize(rawValues)));
+}
+
+// The diff as it was before the sorted merge: every value decoded and
+// compared through a hash, removals found by subtracting key sets
+static QHash<QString, QVariant> diffWithKeySets(const UniIniFile &file, QHash<QString, QVariant> &cached)
+{
+    QHash<QString, QVariant> changes;
+    QSet<QString> currentKeySet;
+    for (const UniIniFile::Entry &entry : file.entries()) {
+        QString key = file.key(entry);
+        QVariant newValue = file.value(entry);
+        auto it = cached.find(key);
+        if (it == cached.end() || *it != newValue) {
+            changes[key] = newValue;
+            cached[key] = newValue;
+        }
+        currentKeySet.insert(key);
+    }
+
+    QStringList cachedKeysList = cached.keys();
+    QSet<QString> cachedKeySet(cachedKeysList.begin(), cachedKeysList.end());
+    QSet<QString> removedKeys = cachedKeySet - currentKeySet;
+    for (const QString &key : removedKeys) {
+        changes[key] = QVariant();
+        cached.remove(key);
+    }
+    return changes;
+}
+
+void BenchUniSettings::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    m_configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + "/unisettings";
+}
+
+void BenchUniSettings::init()
+{
+    QDir(m_configDir).removeRecursively();
+    QVERIFY(QDir().mkpath(m_configDir));
+}
+
+void BenchUniSettings::cleanupTestCase()
+{
+    QDir(m_configDir).removeRecursively();
+}
+
+static void addDiffRows()
+{
+    QTest::addColumn<int>("changed");
+
+    QTest::newRow("unchanged") << 0;
+    QTest::newRow("10 changed") << 10;
+    QTest::newRow("all changed") << keyCount;
+}
+
+void BenchUniSettings::diffKeySets_data()
+{
+    addDiffRows();
+}
+
+// Each iteration diffs to the changed file and back, so the cache ends
+// where it started
+void BenchUniSettings::diffKeySets()
+{
+    QFETCH(int, changed);
+
+    writeConfig(configPath("before"), 0);
+    writeConfig(configPath("after"), changed);
+    const UniIniFile before(configPath("before"));
+    const UniIniFile after(configPath("after"));
+
+    QHash<QString, QVariant> cached;
+    diffWithKeySets(before, cached);
+    QCOMPARE(cached.size(), keyCount);
+
+    QBENCHMARK {
+        const qsizetype forward = diffWithKeySets(after, cached).size();
+        const qsizetype back = diffWithKeySets(before, cached).size();
+        QCOMPARE(forward, qsizetype(changed));
+        QCOMPARE(back, qsizetype(changed));
+    }
+}
+
+void BenchUniSettings::diffSortedMerge_data()
+{
+    addDiffRows();
+}
+
+void BenchUniSettings::diffSortedMerge()
+{
+    QFETCH(int, changed);
+
+    writeConfig(configPath("before"), 0);
+    writeConfig(configPath("after"), changed);
+    const UniIniFile before(configPath("before"));
+    const UniIniFile after(configPath("after"));
+
+    UniSettingsEntries cached;
+    mergeEntries(cached, readEntries(before));
+    QCOMPARE(cached.size(), keyCount);
+
+    QBENCHMARK {
+        const qsizetype forward = mergeEntries(cached, readEntries(after)).size();
+        const qsizetype back = mergeEntries(cached, readEntries(before)).size();
+        QCOMPARE(forward, qsizetype(changed));
+        QCOMPARE(back, qsizetype(changed));
+    }
+}
+
+// Target: under 100ns per hit
+void BenchUniSettings::readHit()
+{
+    UniSettings settings(QStringLiteral("bench_read"));
+    settings.setWriteDelay(60000);
+    settings.beginBatch();
+    for (int i = 0; i < 1000; ++i) {
+        settings.setValue(benchKey(i), i);
+    }
+    settings.commitBatch();
+
+    const QString key = benchKey(500);
+    int sum = 0;
+    QBENCHMARK {
+        sum += settings.value(key).toInt();
+    }
+    QVERIFY(sum > 0);
+}
+
+// The same read as another thread would do it
+void BenchUniSettings::readSnapshot()
+{
+    UniSettings settings(QStringLiteral("bench_read"));
+    settings.setWriteDelay(60000);
+    settings.setValue(benchKey(500), 500);
+
+    const QString key = benchKey(500);
+    int sum = 0;
+    QBENCHMARK {
+        sum += settings.snapshot().value(key).toInt();
+    }
+    QVERIFY(sum > 0);
+}
+
+// What UniSettings used to do on construction: open the file through
+// QSettings and copy every key out of it
+void BenchUniSettings::startupQSettings()
+{
+    writeConfig(configPath("bench_startup"), 0);
+
+    QBENCHMARK {
+        QSettings settings(configPath("bench_startup"), QSettings::IniFormat);
+        QHash<QString, QVariant> cachedValues;
+        for (const QString &key : settings.allKeys()) {
+            cachedValues.insert(key, settings.value(key));
+        }
+        QCOMPARE(cachedValues.size(), keyCount);
+    }
+}
+
+// With -DUNISETTINGS_COMPILED_DB=ON this opens the compiled copy, which
+// the warmup's write leaves behind
+void BenchUniSettings::startupUniSettings()
+{
+    writeConfig(configPath("bench_startup"), 0);
+    {
+        UniSettings warmup(QStringLiteral("bench_startup"), UniSettings::LoadImmediately);
+        warmup.setValue(QStringLiteral("warmup"), true);
+        warmup.sync();
+    }
+
+    QBENCHMARK {
+        UniSettings settings(QStringLiteral("bench_startup"), UniSettings::LoadImmediately);
+        QCOMPARE(settings.value(benchKey(1)).toInt(), 1);
+    }
+}
+
+void BenchUniSettings::dispatch_data()
+{
+    QTest::addColumn<int>("subscribers");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("1000") << 1000;
+}
+
+// One subscriber matches the written key; the rest sit on sibling
+// prefixes. Cost should not grow with their number.
+void BenchUniSettings::dispatch()
+{
+    QFETCH(int, subscribers);
+
+    UniSettings settings(QStringLiteral("bench_dispatch"));
+    settings.setWriteDelay(60000);
+    QObject receiver;
+    int calls = 0;
+    settings.subscribe(QStringLiteral("window/"), &receiver, [&calls](const QString &, const QVariant &) {
+        ++calls;
+    });
+    for (int i = 1; i < subscribers; ++i) {
+        settings.subscribe(QStringLiteral("group%1/").arg(i), &receiver, [&calls](const QString &, const QVariant &) {
+            ++calls;
+        });
+    }
+
+    int value = 0;
+    QBENCHMARK {
+        settings.setValue(QStringLiteral("window/width"), ++value);
+    }
+    QCOMPARE(calls, value);
+}
+
+// First launch: no file yet, every default gets written
+void BenchUniSettings::coldStart()
+{
+    QBENCHMARK {
+        QFile::remove(configPath("bench_coldstart"));
+        ColdStartSettings settings;
+        QCOMPARE(settings.p49(), 49);
+    }
+}
+
+void BenchUniSettings::systemScopeLoad_data()
+{
+    QTest::addColumn<int>("files");
+
+    QTest::newRow("no apps") << 0;
+    QTest::newRow("500 apps") << 500;
+}
+
+// The system-scope instance only exists once per process, so each
+// iteration starts the helper; the "no apps" row is the process overhead
+void BenchUniSettings::systemScopeLoad()
+{
+    QFETCH(int, files);
+
+    for (int i = 0; i < files; ++i) {
+        QSettings settings(configPath(QStringLiteral("bench_app%1").arg(i)), QSettings::IniFormat);
+        for (int key = 0; key < 50; ++key) {
+            settings.setValue(benchKey(key), QStringLiteral("app %1 value %2").arg(i).arg(key));
+        }
+    }
+
+    QBENCHMARK {
+        QProcess helper;
+        helper.start(QStringLiteral(UNISETTINGS_TEST_HELPER), {QStringLiteral("load-system")});
+        QVERIFY(helper.waitForFinished(60000));
+        QCOMPARE(helper.exitStatus(), QProcess::NormalExit);
+        QCOMPARE(helper.exitCode(), 0);
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchUniSettings)
+#include "bench_unisettings.moc"
@@ -0,0 +1,36 @@
+#include "unisettings.h"
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QTextStream>
+
+// Second process for tests and benchmarks that need one. Runs in
+// QStandardPaths test mode, so it sees the same files as its parent.
+//
+//   load-system                      construct the system-scope instance
+//   write <app> <prefix> <count>     write <prefix>/0 .. <count - 1>, each
+//                                    flushed to disk on its own
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStandardPaths::setTestModeEnabled(true);
+
+    const QStringList args = app.arguments().mid(1);
+    const QString mode = args.value(0);
+    if (mode == QLatin1String("load-system")) {
+        UniSettings::instance()->systemValue(QStringLiteral("unused"));
+        return 0;
+    }
+    if (mode == QLatin1String("write") && args.size() == 4) {
+        UniSettings settings(args.at(1));
+        const int count = args.at(3).toInt();
+        for (int i = 0; i < count; ++i) {
+            settings.setValue(args.at(2) + "/" + QString::number(i), i);
+            settings.sync();
+        }
+        return 0;
+    }
+
+    QTextStream(stderr) << "unknown mode: " << mode << Qt::endl;
+    return 2;
+}
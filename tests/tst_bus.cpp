@@ -0,0 +1,116 @@
+#include "unisettings.h"
+
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+// A broker of our own on a private socket, and a helper process writing
+// through it. Nothing else on the system is involved.
+class TestBus : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void deltaAppliedWithoutDiff();
+    void staleBaseFallsBackToWatcher();
+
+private:
+    static void helperWrite(const QString &prefix, int count);
+
+    QTemporaryDir m_runtimeDir;
+    QString m_configDir;
+    QProcess m_broker;
+};
+
+static const QString s_appName = QStringLiteral("tst_bus");
+
+void TestBus::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    m_configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + "/unisettings";
+    QDir(m_configDir).removeRecursively();
+
+    QVERIFY(m_runtimeDir.isValid());
+    const QString socketPath = m_runtimeDir.filePath("bus");
+    // Inherited by the helpers too
+    qputenv("UNISETTINGS_BUS_SOCKET", QFile::encodeName(socketPath));
+    m_broker.start(QStringLiteral(UNISETTINGS_BUS_BROKER), {socketPath});
+    QVERIFY(m_broker.waitForStarted());
+    QTRY_VERIFY(QFile::exists(socketPath));
+}
+
+void TestBus::cleanupTestCase()
+{
+    m_broker.kill();
+    m_broker.waitForFinished();
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestBus::init()
+{
+    QFile::remove(m_configDir + "/" + s_appName + ".conf");
+}
+
+void TestBus::helperWrite(const QString &prefix, int count)
+{
+    QCOMPARE(QProcess::execute(QStringLiteral(UNISETTINGS_TEST_HELPER),
+                               {QStringLiteral("write"), s_appName, prefix, QString::number(count)}), 0);
+}
+
+// Our cache matches the base of every message, so each one is applied as
+// is and the watcher events that follow are skipped by fingerprint
+void TestBus::deltaAppliedWithoutDiff()
+{
+    UniSettings settings(s_appName);
+    settings.setValue("own", 1);
+    settings.sync();
+
+    const UniSettings::Metrics before = settings.metrics();
+    helperWrite(QStringLiteral("bus"), 3);
+    QTRY_COMPARE(settings.metrics().busUpdates, before.busUpdates + 3);
+    for (int i = 0; i < 3; ++i) {
+        QCOMPARE(settings.value("bus/" + QString::number(i)).toInt(), i);
+    }
+
+    // Let the watcher events arrive; none of them may cause a diff
+    QTest::qWait(500);
+    const UniSettings::Metrics after = settings.metrics();
+    QCOMPARE(after.fileChecks - after.diffsSkipped, before.fileChecks - before.diffsSkipped);
+}
+
+// The file changed behind the bus's back first, so the message's base no
+// longer matches what we know; the watcher has to pick both changes up
+void TestBus::staleBaseFallsBackToWatcher()
+{
+    UniSettings settings(s_appName);
+    settings.setValue("own", 1);
+    settings.sync();
+    QTest::qWait(500);
+
+    const UniSettings::Metrics before = settings.metrics();
+    {
+        QSettings direct(m_configDir + "/" + s_appName + ".conf", QSettings::IniFormat);
+        direct.setValue("direct", 2);
+    }
+    // Blocks our event loop, so the direct write's event isn't handled
+    // before the message arrives
+    helperWrite(QStringLiteral("bus"), 1);
+
+    QTRY_VERIFY(settings.value("bus/0").isValid());
+    QCOMPARE(settings.value("bus/0").toInt(), 0);
+    QTRY_COMPARE(settings.value("direct").toInt(), 2);
+    const UniSettings::Metrics after = settings.metrics();
+    QCOMPARE(after.busUpdates, before.busUpdates);
+    QVERIFY(after.fileChecks - after.diffsSkipped > before.fileChecks - before.diffsSkipped);
+}
+
+QTEST_GUILESS_MAIN(TestBus)
+#include "tst_bus.moc"
@@ -0,0 +1,384 @@
+#include "unisettings.h"
+#include "unisettings_ini.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QPoint>
+#include <QRect>
+#include <QSettings>
+#include <QSize>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimeZone>
+#include <QUrl>
+
+// Files written by QSettings must read the same through UniIniFile, and
+// files UniIniFile writes must read the same through QSettings. QSettings
+// is the reference throughout, quirks included.
+class TestIniFormat : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void qsettingsToUni_data();
+    void qsettingsToUni();
+    void uniToQSettings_data();
+    void uniToQSettings();
+    void wholeFile();
+    void handWritten_data();
+    void handWritten();
+    void normalizedKey_data();
+    void normalizedKey();
+    void settingsKeys_data();
+    void settingsKeys();
+    void removeGroup_data();
+    void removeGroup();
+
+private:
+    QString path(const QString &name) const { return m_dir.filePath(name); }
+
+    QTemporaryDir m_dir;
+};
+
+static void addValueRows()
+{
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QVariant>("value");
+
+    QTest::newRow("int") << "int" << QVariant(42);
+    QTest::newRow("negative") << "negative" << QVariant(-7);
+    QTest::newRow("longlong") << "longlong" << QVariant(Q_INT64_C(1) << 40);
+    QTest::newRow("double") << "double" << QVariant(0.1);
+    QTest::newRow("bool") << "bool" << QVariant(true);
+    QTest::newRow("string") << "string" << QVariant(QStringLiteral("plain"));
+    QTest::newRow("empty string") << "empty" << QVariant(QString());
+    QTest::newRow("outer spaces") << "spaces" << QVariant(QStringLiteral("  padded  "));
+    QTest::newRow("specials") << "specials" << QVariant(QStringLiteral("a;b=c,d"));
+    QTest::newRow("quotes") << "quotes" << QVariant(QStringLiteral("say \"hi\""));
+    QTest::newRow("backslash") << "backslash" << QVariant(QStringLiteral("C:\\path\\file"));
+    QTest::newRow("control") << "control" << QVariant(QStringLiteral("tab\there\nnewline\r\x01"));
+    QTest::newRow("nul") << "nul" << QVariant(QString(QStringLiteral("a")) + QChar(0) + QStringLiteral("1"));
+    QTest::newRow("at sign") << "at" << QVariant(QStringLiteral("@notatype"));
+    QTest::newRow("non-ascii value") << "unicode" << QVariant(QStringLiteral("Привет, 世界 \U0001F600"));
+    QTest::newRow("bytearray") << "bytes" << QVariant(QByteArray("\0\x01\x7f\xff raw", 9));
+    QTest::newRow("stringlist") << "list" << QVariant(QStringList{"a", "b c", "d,e", "@f"});
+    QTest::newRow("empty list") << "emptylist" << QVariant(QStringList());
+    QTest::newRow("single list") << "single" << QVariant(QStringList{"only"});
+    QTest::newRow("variantlist") << "vlist" << QVariant(QVariantList{1, QStringLiteral("two"), 3.5});
+    QTest::newRow("single variantlist") << "vsingle" << QVariant(QVariantList{QPoint(1, 2)});
+    QTest::newRow("rect") << "rect" << QVariant(QRect(1, 2, 30, 40));
+    QTest::newRow("size") << "size" << QVariant(QSize(800, 600));
+    QTest::newRow("point") << "point" << QVariant(QPoint(-5, 9));
+    QTest::newRow("datetime") << "datetime"
+                              << QVariant(QDateTime(QDate(2024, 2, 29), QTime(13, 37, 1), QTimeZone::UTC));
+    QTest::newRow("@Variant map") << "map"
+                                  << QVariant(QVariantMap{{"x", 1}, {"y", QStringLiteral("z")}});
+    QTest::newRow("@Variant url") << "url" << QVariant(QUrl(QStringLiteral("https://example.org/a b")));
+
+    QTest::newRow("group") << "window/width" << QVariant(1024);
+    QTest::newRow("nested group") << "a/b/c/d" << QVariant(1);
+    QTest::newRow("group general") << "general/key" << QVariant(1);
+    QTest::newRow("group General") << "General/key" << QVariant(2);
+    QTest::newRow("group %general") << "%general/key" << QVariant(3);
+    QTest::newRow("non-ascii key") << QStringLiteral("настройки/ключ") << QVariant(4);
+    QTest::newRow("spaced key") << "a key/with spaces" << QVariant(5);
+    QTest::newRow("special key") << "semi;colon=equals%percent" << QVariant(6);
+    QTest::newRow("bracket group") << "[odd]/key" << QVariant(7);
+}
+
+// Keys and values as QSettings reads them back from file
+static void compareWithQSettings(const QString &file)
+{
+    QSettings reference(file, QSettings::IniFormat);
+    UniIniFile uni(file);
+
+    QStringList keys;
+    for (const UniIniFile::Entry &entry : uni.entries()) {
+        keys.append(uni.key(entry));
+    }
+    keys.removeDuplicates();
+    keys.sort();
+    QStringList expected = reference.allKeys();
+    expected.sort();
+    QCOMPARE(keys, expected);
+
+    for (const QString &key : std::as_const(expected)) {
+        QCOMPARE(uni.value(key), reference.value(key));
+    }
+}
+
+void TestIniFormat::initTestCase()
+{
+    // For the UniSettings rows, which write where the library does
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void TestIniFormat::init()
+{
+    QVERIFY(m_dir.isValid());
+    for (const QString &name : QDir(m_dir.path()).entryList(QDir::Files)) {
+        QFile::remove(path(name));
+    }
+}
+
+void TestIniFormat::qsettingsToUni_data()
+{
+    addValueRows();
+}
+
+void TestIniFormat::qsettingsToUni()
+{
+    QFETCH(QString, key);
+    QFETCH(QVariant, value);
+
+    const QString file = path("qsettings.conf");
+    {
+        QSettings settings(file, QSettings::IniFormat);
+        settings.setValue(key, value);
+    }
+    compareWithQSettings(file);
+}
+
+void TestIniFormat::uniToQSettings_data()
+{
+    addValueRows();
+}
+
+void TestIniFormat::uniToQSettings()
+{
+    QFETCH(QString, key);
+    QFETCH(QVariant, value);
+
+    const QString referenceFile = path("reference.conf");
+    {
+        QSettings settings(referenceFile, QSettings::IniFormat);
+        settings.setValue(key, value);
+    }
+
+    const QString file = path("uni.conf");
+    QMap<QString, QByteArray> rawValues;
+    rawValues.insert(key, UniIniFile::encodeValue(value));
+    QVERIFY(UniIniFile::writeFile(file, UniIniFile::serialize(rawValues)));
+
+    // Same bytes as QSettings, so QSettings and we read it the same way
+    QFile written(file);
+    QFile expected(referenceFile);
+    QVERIFY(written.open(QIODevice::ReadOnly));
+    QVERIFY(expected.open(QIODevice::ReadOnly));
+    QCOMPARE(written.readAll(), expected.readAll());
+
+    QSettings reference(referenceFile, QSettings::IniFormat);
+    QSettings settings(file, QSettings::IniFormat);
+    QCOMPARE(settings.allKeys(), reference.allKeys());
+    for (const QString &readKey : reference.allKeys()) {
+        QCOMPARE(settings.value(readKey), reference.value(readKey));
+    }
+    compareWithQSettings(file);
+}
+
+// Every value in one file, then through UniIniFile and back out again
+void TestIniFormat::wholeFile()
+{
+    const QString referenceFile = path("all.conf");
+    {
+        QSettings settings(referenceFile, QSettings::IniFormat);
+        const QList<std::pair<QString, QVariant>> values{
+            {"int", 42},
+            {"string", QStringLiteral("a;b=c,d")},
+            {"list", QStringList{"a", "b c", "d,e"}},
+            {"map", QVariantMap{{"x", 1}}},
+            {"general/key", 1},
+            {QStringLiteral("настройки/ключ"), QStringLiteral("значение")},
+            {"window/width", 1024},
+            {"window/geometry/x", 5},
+            {"quoted", QStringLiteral("\"quoted\"")},
+        };
+        for (const auto &[key, value] : values) {
+            settings.setValue(key, value);
+        }
+    }
+    compareWithQSettings(referenceFile);
+
+    UniIniFile uni(referenceFile);
+    QMap<QString, QByteArray> rawValues;
+    for (const UniIniFile::Entry &entry : uni.entries()) {
+        rawValues.insert(uni.key(entry), entry.value.toByteArray());
+    }
+    const QString file = path("rewritten.conf");
+    QVERIFY(UniIniFile::writeFile(file, UniIniFile::serialize(rawValues)));
+
+    QSettings reference(referenceFile, QSettings::IniFormat);
+    QSettings settings(file, QSettings::IniFormat);
+    QCOMPARE(settings.allKeys(), reference.allKeys());
+    for (const QString &key : reference.allKeys()) {
+        QCOMPARE(settings.value(key), reference.value(key));
+    }
+}
+
+// Things QSettings never writes itself but reads from hand-edited files
+void TestIniFormat::handWritten_data()
+{
+    QTest::addColumn<QByteArray>("contents");
+
+    QTest::newRow("comments") << QByteArray("; leading\n[General]\na=1 ; trailing\n;b=2\n");
+    QTest::newRow("bom and crlf") << QByteArray("\xef\xbb\xbf[General]\r\na=1\r\n\r\n[g]\r\nb=2\r\n");
+    QTest::newRow("spacing") << QByteArray("[ spaced ]\n  key  =  value with spaces  \n");
+    QTest::newRow("duplicates") << QByteArray("[g]\nk=one\nk=two\n[g]\nk=three\n");
+    QTest::newRow("no section") << QByteArray("top=1\n[s]\nx=2\n");
+    QTest::newRow("continuation") << QByteArray("[g]\nk=first \\\n  second\nq=\"multi\nline\"\n");
+    QTest::newRow("escapes") << QByteArray("[g]\nk=\\x41\\101\\t\\\"\\q\n");
+    QTest::newRow("unterminated") << QByteArray("[g\nk=\"open\n");
+    QTest::newRow("empty value") << QByteArray("[g]\nk=\nl=,\n");
+    QTest::newRow("lowercase general") << QByteArray("[general]\na=1\n[%GENERAL]\nb=2\n");
+}
+
+void TestIniFormat::handWritten()
+{
+    QFETCH(QByteArray, contents);
+
+    const QString file = path("hand.conf");
+    QVERIFY(UniIniFile::writeFile(file, contents));
+    compareWithQSettings(file);
+}
+
+// Keys QSettings normalizes before they reach the file
+static void addKeyRows()
+{
+    QTest::addColumn<QString>("group");
+    QTest::addColumn<QString>("key");
+
+    QTest::newRow("plain") << QString() << "a/b";
+    QTest::newRow("double slash") << QString() << "window//width";
+    QTest::newRow("leading slash") << QString() << "/leading";
+    QTest::newRow("trailing slash") << QString() << "trailing/";
+    QTest::newRow("all of them") << QString() << "//a///b//";
+    QTest::newRow("group with trailing slash") << "window/" << "width";
+    QTest::newRow("group with leading slash") << "/window" << "width";
+    QTest::newRow("key with leading slash") << "window" << "/width";
+    QTest::newRow("doubled group") << "a//b" << "c/";
+}
+
+void TestIniFormat::normalizedKey_data()
+{
+    addKeyRows();
+}
+
+void TestIniFormat::normalizedKey()
+{
+    QFETCH(QString, group);
+    QFETCH(QString, key);
+
+    const QString referenceFile = path("reference.conf");
+    {
+        QSettings settings(referenceFile, QSettings::IniFormat);
+        settings.beginGroup(group);
+        settings.setValue(key, 1);
+    }
+    const QStringList referenceKeys = QSettings(referenceFile, QSettings::IniFormat).allKeys();
+    QCOMPARE(referenceKeys.size(), 1);
+    const QString normalized = UniIniFile::normalizedKey(group.isEmpty() ? key : group + "/" + key);
+    QCOMPARE(normalized, referenceKeys.first());
+
+    // No empty sections or keys on disk either
+    const QString file = path("uni.conf");
+    QMap<QString, QByteArray> rawValues;
+    rawValues.insert(normalized, UniIniFile::encodeValue(1));
+    QVERIFY(UniIniFile::writeFile(file, UniIniFile::serialize(rawValues)));
+    QFile written(file);
+    QFile expected(referenceFile);
+    QVERIFY(written.open(QIODevice::ReadOnly));
+    QVERIFY(expected.open(QIODevice::ReadOnly));
+    QCOMPARE(written.readAll(), expected.readAll());
+}
+
+// The same writes through UniSettings and QSettings end up as the same keys
+void TestIniFormat::settingsKeys_data()
+{
+    addKeyRows();
+}
+
+void TestIniFormat::settingsKeys()
+{
+    QFETCH(QString, group);
+    QFETCH(QString, key);
+
+    const QString referenceFile = path("reference.conf");
+    {
+        QSettings settings(referenceFile, QSettings::IniFormat);
+        settings.beginGroup(group);
+        settings.setValue(key, 1);
+        QCOMPARE(settings.value(key).toInt(), 1);
+    }
+
+    const QString appName = QStringLiteral("tst_iniformat_keys");
+    const QString file = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
+            + "/unisettings/" + appName + ".conf";
+    QFile::remove(file);
+    {
+        UniSettings settings(appName);
+        settings.beginGroup(group);
+        settings.setValue(key, 1);
+        QCOMPARE(settings.value(key).toInt(), 1);
+        settings.sync();
+    }
+
+    QCOMPARE(QSettings(file, QSettings::IniFormat).allKeys(),
+             QSettings(referenceFile, QSettings::IniFormat).allKeys());
+    QFile::remove(file);
+}
+
+// remove("") removes the current group, or everything outside of one
+void TestIniFormat::removeGroup_data()
+{
+    QTest::addColumn<QString>("group");
+
+    QTest::newRow("in group") << "g";
+    QTest::newRow("nested group") << "g/h";
+    QTest::newRow("no group") << QString();
+}
+
+void TestIniFormat::removeGroup()
+{
+    QFETCH(QString, group);
+
+    const QStringList keys{"g/a", "g/h/b", "gg/c", "other"};
+    const QString referenceFile = path("reference.conf");
+    {
+        QSettings settings(referenceFile, QSettings::IniFormat);
+        for (const QString &key : keys) {
+            settings.setValue(key, 1);
+        }
+        settings.beginGroup(group);
+        settings.remove(QString());
+    }
+
+    const QString appName = QStringLiteral("tst_iniformat_remove");
+    const QString file = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
+            + "/unisettings/" + appName + ".conf";
+    QFile::remove(file);
+    {
+        UniSettings settings(appName);
+        for (const QString &key : keys) {
+            settings.setValue(key, 1);
+        }
+        settings.beginGroup(group);
+        settings.remove(QString());
+        settings.endGroup();
+        QStringList expected = QSettings(referenceFile, QSettings::IniFormat).allKeys();
+        expected.sort();
+        QCOMPARE(settings.allKeys(), expected);
+        settings.sync();
+    }
+
+    QCOMPARE(QSettings(file, QSettings::IniFormat).allKeys(),
+             QSettings(referenceFile, QSettings::IniFormat).allKeys());
+    QFile::remove(file);
+}
+
+QTEST_GUILESS_MAIN(TestIniFormat)
+#include "tst_iniformat.moc"
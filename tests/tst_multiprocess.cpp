@@ -0,0 +1,96 @@
+#include "unisettings.h"
+
+#include <QDir>
+#include <QProcess>
+#include <QSet>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+// Two helper processes and this one write the same config file at once.
+// Every write has to land in the file, every foreign one has to reach us,
+// and none of ours may come back as an external change.
+class TestMultiProcess : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void concurrentWriters();
+
+private:
+    QString m_configDir;
+};
+
+void TestMultiProcess::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    m_configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + "/unisettings";
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestMultiProcess::cleanupTestCase()
+{
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestMultiProcess::concurrentWriters()
+{
+    const QString appName = QStringLiteral("tst_multiprocess");
+    const int count = 200;
+
+    UniSettings settings(appName);
+    QSignalSpy external(&settings, &UniSettings::externalValueChanged);
+
+    QProcess first;
+    QProcess second;
+    first.start(QStringLiteral(UNISETTINGS_TEST_HELPER),
+                {QStringLiteral("write"), appName, QStringLiteral("first"), QString::number(count)});
+    second.start(QStringLiteral(UNISETTINGS_TEST_HELPER),
+                 {QStringLiteral("write"), appName, QStringLiteral("second"), QString::number(count)});
+    QVERIFY(first.waitForStarted());
+    QVERIFY(second.waitForStarted());
+
+    // Our writes go out one by one too, with watcher events handled in
+    // between, so foreign changes arrive around our own
+    for (int i = 0; i < count; ++i) {
+        settings.setValue("self/" + QString::number(i), i);
+        settings.sync();
+        QCoreApplication::processEvents();
+    }
+
+    QVERIFY(first.waitForFinished(60000));
+    QVERIFY(second.waitForFinished(60000));
+    QCOMPARE(first.exitCode(), 0);
+    QCOMPARE(second.exitCode(), 0);
+
+    const QStringList prefixes{QStringLiteral("self"), QStringLiteral("first"), QStringLiteral("second")};
+    QTRY_COMPARE_WITH_TIMEOUT(settings.allKeys().size(), count * int(prefixes.size()), 10000);
+    for (const QString &prefix : prefixes) {
+        for (int i = 0; i < count; ++i) {
+            QCOMPARE(settings.value(prefix + "/" + QString::number(i)).toInt(), i);
+        }
+    }
+
+    QSettings file(m_configDir + "/" + appName + ".conf", QSettings::IniFormat);
+    QCOMPARE(file.allKeys().size(), count * int(prefixes.size()));
+    for (const QString &prefix : prefixes) {
+        for (int i = 0; i < count; ++i) {
+            QCOMPARE(file.value(prefix + "/" + QString::number(i)).toInt(), i);
+        }
+    }
+
+    QSet<QString> reported;
+    for (const QList<QVariant> &arguments : std::as_const(external)) {
+        const QString key = arguments.at(1).toString();
+        QVERIFY2(!key.startsWith(QLatin1String("self/")), qPrintable(key));
+        reported.insert(key);
+    }
+    QCOMPARE(reported.size(), 2 * count);
+}
+
+QTEST_GUILESS_MAIN(TestMultiProcess)
+#include "tst_multiprocess.moc"
@@ -0,0 +1,111 @@
+#include "unisettings.h"
+
+#include <QDir>
+#include <QProcess>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTest>
+#include <sys/mman.h>
+
+// Cross-app reads served by a standalone unisettings-publisher through a
+// segment of our own, against the same config directory as ours
+class TestShm : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void readsFromPublisher();
+    void followsOtherProcesses();
+    void ownWritesReadBackAtOnce();
+    void fallsBackWithoutPublisher();
+
+private:
+    QString m_configDir;
+    QProcess m_publisher;
+};
+
+void TestShm::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    const QString configRoot = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
+    m_configDir = configRoot + "/unisettings";
+    QDir(m_configDir).removeRecursively();
+    QVERIFY(QDir().mkpath(m_configDir));
+    qputenv("UNISETTINGS_SHM_NAME", "/unisettings-test-" + QByteArray::number(QCoreApplication::applicationPid()));
+
+    {
+        QSettings settings(m_configDir + "/tst_shm_app.conf", QSettings::IniFormat);
+        settings.setValue("key", 1);
+    }
+
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("XDG_CONFIG_HOME"), configRoot);
+    m_publisher.setProcessEnvironment(environment);
+    m_publisher.start(QStringLiteral(UNISETTINGS_PUBLISHER), QStringList());
+    QVERIFY(m_publisher.waitForStarted());
+}
+
+void TestShm::cleanupTestCase()
+{
+    if (m_publisher.state() != QProcess::NotRunning) {
+        m_publisher.kill();
+        m_publisher.waitForFinished();
+    }
+    ::shm_unlink(qgetenv("UNISETTINGS_SHM_NAME").constData());
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestShm::readsFromPublisher()
+{
+    UniSettings settings(QStringLiteral("tst_shm_reader"));
+    // The publisher has to load and publish first
+    QTRY_VERIFY_WITH_TIMEOUT(settings.appValue("tst_shm_app", "key").toInt() == 1
+                             && settings.metrics().sharedReads > 0, 10000);
+
+    const quint64 before = settings.metrics().sharedReads;
+    QCOMPARE(settings.appValue("tst_shm_app", "key").toInt(), 1);
+    QCOMPARE(settings.appValue("tst_shm_app", "missing", 7).toInt(), 7);
+    QCOMPARE(settings.metrics().sharedReads, before + 2);
+}
+
+void TestShm::followsOtherProcesses()
+{
+    UniSettings settings(QStringLiteral("tst_shm_reader"));
+    QCOMPARE(QProcess::execute(QStringLiteral(UNISETTINGS_TEST_HELPER),
+                               {QStringLiteral("write"), QStringLiteral("tst_shm_app"),
+                                QStringLiteral("other"), QStringLiteral("3")}), 0);
+    QTRY_COMPARE_WITH_TIMEOUT(settings.appValue("tst_shm_app", "other/2").toInt(), 2, 10000);
+}
+
+// Right after sync(), before the publisher's watcher caught up
+void TestShm::ownWritesReadBackAtOnce()
+{
+    UniSettings writer(QStringLiteral("tst_shm_app"));
+    writer.setValue("key", 2);
+    writer.sync();
+    QCOMPARE(writer.appValue("tst_shm_app", "key").toInt(), 2);
+
+    // Back on shared memory once the publisher has republished
+    const quint64 before = writer.metrics().sharedReads;
+    QTRY_VERIFY_WITH_TIMEOUT(writer.appValue("tst_shm_app", "key").toInt() == 2
+                             && writer.metrics().sharedReads > before, 10000);
+}
+
+void TestShm::fallsBackWithoutPublisher()
+{
+    m_publisher.kill();
+    QVERIFY(m_publisher.waitForFinished());
+
+    UniSettings settings(QStringLiteral("tst_shm_reader"));
+    // Readers notice the publisher is gone within a second
+    QTest::qWait(1100);
+    const quint64 before = settings.metrics().sharedReads;
+    QCOMPARE(settings.appValue("tst_shm_app", "key").toInt(), 2);
+    QCOMPARE(settings.metrics().sharedReads, before);
+}
+
+QTEST_GUILESS_MAIN(TestShm)
+#include "tst_shm.moc"
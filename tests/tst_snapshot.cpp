@@ -0,0 +1,152 @@
+#include "unisettings.h"
+
+#include <QDir>
+#include <QStandardPaths>
+#include <QTest>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Readers on other threads pin snapshots while the owner keeps publishing
+// new ones. Meant to be run under ThreadSanitizer as well
+// (-DUNISETTINGS_SANITIZE_THREAD=ON), which checks the slot's ordering.
+class TestSnapshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void readersDuringPublish();
+    void publishedLazily();
+    void snapshotsOutliveSettings();
+
+private:
+    QString m_configDir;
+};
+
+void TestSnapshot::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    m_configDir = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + "/unisettings";
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestSnapshot::cleanupTestCase()
+{
+    QDir(m_configDir).removeRecursively();
+}
+
+void TestSnapshot::readersDuringPublish()
+{
+    const int readerCount = qMax(2, QThread::idealThreadCount());
+    const int writes = 20000;
+
+    UniSettings settings(QStringLiteral("tst_snapshot"));
+    // Keep the disk out of it. Writes are published lazily, so the owner
+    // takes a snapshot after each one to force a publish.
+    settings.setWriteDelay(60000);
+    settings.setValue("a", 0);
+    settings.setValue("b", 0);
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> violations{0};
+    std::atomic<qint64> reads{0};
+    std::vector<std::unique_ptr<QThread>> readers;
+    for (int i = 0; i < readerCount; ++i) {
+        readers.emplace_back(QThread::create([&]() {
+            int lastA = 0;
+            qint64 count = 0;
+            // Held across iterations so retired snapshots stay pinned a while
+            UniSettings::Snapshot kept;
+            while (!stop.load(std::memory_order_relaxed)) {
+                UniSettings::Snapshot snapshot = settings.snapshot();
+                const int a = snapshot.value("a").toInt();
+                const int b = snapshot.value("b").toInt();
+                // "a" is written before "b", each write publishing once
+                if (a < lastA || b > a || a > b + 1) {
+                    violations.fetch_add(1);
+                }
+                lastA = a;
+                if (++count % 64 == 0) {
+                    kept = snapshot;
+                } else {
+                    UniSettings::Snapshot moved(std::move(snapshot));
+                    if (moved.isNull()) {
+                        violations.fetch_add(1);
+                    }
+                }
+            }
+            reads.fetch_add(count);
+        }));
+        readers.back()->start();
+    }
+
+    for (int i = 1; i <= writes; ++i) {
+        settings.setValue("a", i);
+        settings.snapshot();
+        settings.setValue("b", i);
+        settings.snapshot();
+    }
+    stop.store(true);
+    for (const std::unique_ptr<QThread> &reader : readers) {
+        QVERIFY(reader->wait(30000));
+    }
+
+    QCOMPARE(violations.load(), 0);
+    QVERIFY(reads.load() > 0);
+    QCOMPARE(settings.snapshot().value("a").toInt(), writes);
+    settings.clear();
+}
+
+// What another thread sees of writes the owner hasn't published yet
+static int readOnOtherThread(UniSettings &settings, const QString &key)
+{
+    int value = -1;
+    std::unique_ptr<QThread> reader(QThread::create([&]() {
+        value = settings.snapshot().value(key).toInt();
+    }));
+    reader->start();
+    reader->wait();
+    return value;
+}
+
+void TestSnapshot::publishedLazily()
+{
+    UniSettings settings(QStringLiteral("tst_snapshot_lazy"));
+    settings.setWriteDelay(60000);
+    settings.setValue("key", 1);
+    settings.snapshot();
+
+    // Published at the outermost commit, not per write
+    settings.beginBatch();
+    settings.setValue("key", 2);
+    settings.setValue("key", 3);
+    QCOMPARE(readOnOtherThread(settings, "key"), 1);
+    settings.commitBatch();
+    QCOMPARE(readOnOtherThread(settings, "key"), 3);
+
+    // Outside a batch, once the event loop runs
+    settings.setValue("key", 4);
+    QCOMPARE(settings.value("key").toInt(), 4);
+    QTRY_COMPARE(readOnOtherThread(settings, "key"), 4);
+    settings.clear();
+}
+
+void TestSnapshot::snapshotsOutliveSettings()
+{
+    UniSettings::Snapshot snapshot;
+    {
+        UniSettings settings(QStringLiteral("tst_snapshot_outlive"));
+        settings.setValue("key", 42);
+        snapshot = settings.snapshot();
+        settings.setValue("key", 43);
+        settings.clear();
+    }
+    QCOMPARE(snapshot.value("key").toInt(), 42);
+}
+
+QTEST_GUILESS_MAIN(TestSnapshot)
+#include "tst_snapshot.moc"
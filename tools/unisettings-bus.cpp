@@ -0,0 +1,131 @@
+#include "src/unisettings_bus.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Relays every message a client sends to all other connected clients, so
+// one write reaches every process's UniSettings without a file read.
+// Messages are never queued: a client too slow to take one misses it and
+// catches up through its file watcher instead.
+class UniSettingsBusBroker
+{
+public:
+    ~UniSettingsBusBroker()
+    {
+        for (auto it = m_clients.constBegin(); it != m_clients.constEnd(); ++it) {
+            delete it.value();
+            ::close(it.key());
+        }
+        if (m_listenFd >= 0) {
+            ::close(m_listenFd);
+            ::unlink(m_path.constData());
+        }
+    }
+
+    bool listen(const QString &path)
+    {
+        m_path = QFile::encodeName(path);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (m_path.size() >= qsizetype(sizeof(address.sun_path))) {
+            qWarning() << "Socket path too long:" << path;
+            return false;
+        }
+        std::memcpy(address.sun_path, m_path.constData(), m_path.size());
+
+        m_listenFd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_listenFd < 0) {
+            qWarning() << "Failed to create socket:" << strerror(errno);
+            return false;
+        }
+        // A broker that died left its socket file behind
+        ::unlink(m_path.constData());
+        if (::bind(m_listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(m_listenFd, 64) != 0) {
+            qWarning() << "Failed to listen on" << path << ":" << strerror(errno);
+            return false;
+        }
+
+        auto *notifier = new QSocketNotifier(m_listenFd, QSocketNotifier::Read);
+        QObject::connect(notifier, &QSocketNotifier::activated, notifier, [this]() {
+            acceptClients();
+        });
+        m_listenNotifier.reset(notifier);
+        return true;
+    }
+
+private:
+    void acceptClients()
+    {
+        for (;;) {
+            const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            auto *notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+            QObject::connect(notifier, &QSocketNotifier::activated, notifier, [this, fd]() {
+                relayFrom(fd);
+            });
+            m_clients.insert(fd, notifier);
+        }
+    }
+
+    void relayFrom(int fd)
+    {
+        for (;;) {
+            const ssize_t size = ::recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+            if (size <= 0) {
+                if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    dropClient(fd);
+                }
+                return;
+            }
+            QByteArray data(size, Qt::Uninitialized);
+            if (::recv(fd, data.data(), data.size(), 0) != size) {
+                dropClient(fd);
+                return;
+            }
+            for (auto it = m_clients.constBegin(); it != m_clients.constEnd(); ++it) {
+                if (it.key() != fd) {
+                    ::send(it.key(), data.constData(), data.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                }
+            }
+        }
+    }
+
+    void dropClient(int fd)
+    {
+        QSocketNotifier *notifier = m_clients.take(fd);
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+        ::close(fd);
+    }
+
+    QByteArray m_path;
+    int m_listenFd = -1;
+    std::unique_ptr<QSocketNotifier> m_listenNotifier;
+    QHash<int, QSocketNotifier *> m_clients;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const QStringList arguments = app.arguments();
+    const QString path = arguments.size() > 1 ? arguments.at(1) : UniSettingsBus::socketPath();
+
+    UniSettingsBusBroker broker;
+    if (!broker.listen(path)) {
+        return 1;
+    }
+    return app.exec();
+}
@@ -0,0 +1,12 @@
+#include "src/unisettings.h"
+
+#include <QCoreApplication>
+
+// Holds the system-scope instance, and with it the shared memory snapshot of
+// every app's settings, on sessions where no other process keeps one alive
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    UniSettings::instance();
+    return app.exec();
+}